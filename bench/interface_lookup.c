@@ -0,0 +1,152 @@
+/*
+ * This file is part of liboo.
+ */
+
+/**
+ * @file	interface_lookup.c
+ * @brief	Microbenchmark for the searched itable lookup of the runtime
+ *
+ * Builds a class implementing n interfaces by hand, the way the compiler lays
+ * out searched ITTs, and lets 1, 2, 4, ... threads dispatch interface calls
+ * on objects of that class. All threads share the class' ITT and with it the
+ * move-to-front hints, so the m2f lookup shows how the hints behave under
+ * contention. The plain searched lookup is measured for comparison.
+ * Needs no libfirm, only the runtime library.
+ *
+ * usage: interface_lookup [interfaces] [max threads] [calls per thread]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src-cpp/rt/rt.h"
+
+typedef void *(*lookup_t)(const object_t *obj, void *interface_id,
+                          uint32_t key, int32_t offset);
+
+typedef struct {
+	lookup_t        lookup;
+	const object_t *obj;
+	unsigned long   n_calls;
+	unsigned        seed;
+	uintptr_t       checksum;
+	pthread_t       thread;
+} worker_t;
+
+static unsigned     n_interfaces;
+static char        *interface_ids;
+static void       **itables;
+static itt_entry_t *itt;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t get_key(unsigned i)
+{
+	return i * 2654435761u;
+}
+
+/* a searched ITT: header with the packed keys, entries sorted by key */
+static vtable_t *build_vtable(void)
+{
+	itt      = calloc(n_interfaces + 1, sizeof(*itt));
+	itables  = calloc(n_interfaces, sizeof(*itables));
+	interface_ids = calloc(n_interfaces, 1);
+
+	uint32_t *keys = calloc(n_interfaces + 1, sizeof(*keys));
+	keys[0] = n_interfaces;
+	itt[0].itable = (void**)keys;
+
+	/* insertion sort by key */
+	for (unsigned i = 0; i < n_interfaces; i++) {
+		uint32_t key = get_key(i);
+		unsigned pos = i + 1;
+		while (pos > 1 && keys[pos - 1] > key) {
+			keys[pos] = keys[pos - 1];
+			itt[pos]  = itt[pos - 1];
+			pos--;
+		}
+		keys[pos]       = key;
+		itables[i]      = &itables[i];
+		itt[pos].itable = (void**)&itables[i];
+		itt[pos].id     = &interface_ids[i];
+	}
+
+	vtable_t *vtable = calloc(1, sizeof(*vtable));
+	vtable->itt = itt;
+	return vtable;
+}
+
+static void *run_worker(void *data)
+{
+	worker_t *worker  = data;
+	unsigned  seed    = worker->seed;
+	uintptr_t sum     = 0;
+	/* most calls go to a few hot interfaces, like a loop calling methods of
+	 * two interfaces of its receiver */
+	unsigned  hot[2]  = { n_interfaces - 1, n_interfaces / 2 };
+	for (unsigned long c = 0; c < worker->n_calls; c++) {
+		seed = seed * 1103515245u + 12345u;
+		unsigned i = (seed >> 16) % 16 == 0 ? (seed >> 8) % n_interfaces
+		                                    : hot[c & 1];
+		void *res = worker->lookup(worker->obj, &interface_ids[i], get_key(i), 0);
+		sum += (uintptr_t)res;
+	}
+	worker->checksum = sum;
+	return NULL;
+}
+
+static void measure(const char *name, lookup_t lookup, const object_t *obj,
+                    unsigned n_threads, unsigned long n_calls)
+{
+	worker_t *workers = calloc(n_threads, sizeof(*workers));
+	double    start   = now();
+	for (unsigned t = 0; t < n_threads; t++) {
+		workers[t].lookup  = lookup;
+		workers[t].obj     = obj;
+		workers[t].n_calls = n_calls;
+		workers[t].seed    = t + 1;
+		pthread_create(&workers[t].thread, NULL, run_worker, &workers[t]);
+	}
+	for (unsigned t = 0; t < n_threads; t++)
+		pthread_join(workers[t].thread, NULL);
+	double time = now() - start;
+
+	double total = (double)n_calls * n_threads;
+	printf("%-10s threads: %2u  %7.2f ns/call  %8.2f Mcalls/s\n", name,
+	       n_threads, time * 1e9 * n_threads / total, total / time * 1e-6);
+	free(workers);
+}
+
+int main(int argc, char **argv)
+{
+	n_interfaces              = argc > 1 ? (unsigned)atoi(argv[1]) : 32;
+	unsigned      max_threads = argc > 2 ? (unsigned)atoi(argv[2]) : 8;
+	unsigned long n_calls     = argc > 3 ? strtoul(argv[3], NULL, 10) : 10000000;
+	if (n_interfaces < 2) {
+		fprintf(stderr, "need at least 2 interfaces\n");
+		return 1;
+	}
+
+	object_t obj = { build_vtable() };
+
+	for (unsigned n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+		measure("searched", oo_searched_itable_method, &obj, n_threads, n_calls);
+		measure("m2f", oo_searched_itable_method_m2f, &obj, n_threads, n_calls);
+	}
+
+	free(obj.vptr);
+	free(itt[0].itable);
+	free(itt);
+	free(itables);
+	free(interface_ids);
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * This file is part of liboo.
+ */
+
+/**
+ * @file	rta_hierarchy.c
+ * @brief	Microbenchmark for rta_optimization on a synthetic class hierarchy
+ *
+ * Builds a complete class tree of the given depth and fanout in which every
+ * class overrides all methods of the root class. All classes are live and a
+ * single entry point calls every root method dynamically, so the analysis has
+ * to resolve each call to all classes of the tree.
+ *
+ * usage: rta_hierarchy [depth] [fanout] [methods]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libfirm/firm.h>
+#include <liboo/oo.h>
+#include <liboo/nodes.h>
+#include <liboo/rta.h>
+
+static unsigned   n_methods;
+static ir_type   *method_type;
+static ir_type  **classes;
+static size_t     n_classes;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_empty_graph(ir_entity *method)
+{
+	ir_graph *irg   = new_ir_graph(method, 0);
+	ir_node  *block = get_r_cur_block(irg);
+	ir_node  *ret   = new_r_Return(block, get_irg_initial_mem(irg), 0, NULL);
+	add_immBlock_pred(get_irg_end_block(irg), ret);
+	irg_finalize_cons(irg);
+}
+
+static ir_type *build_class(ir_type *superclass, unsigned nr)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "C%u", nr);
+	ir_type *klass = new_type_class(new_id_from_str(name));
+	if (superclass != NULL)
+		add_class_supertype(klass, superclass);
+
+	for (unsigned i = 0; i < n_methods; ++i) {
+		snprintf(name, sizeof(name), "m%u", i);
+		ir_entity *method = new_entity(klass, new_id_from_str(name), method_type);
+		snprintf(name, sizeof(name), "C%u.m%u", nr, i);
+		set_entity_ld_ident(method, new_id_from_str(name));
+		oo_set_entity_binding(method, bind_dynamic);
+		if (superclass != NULL) {
+			ir_entity *overwritten = get_class_member(superclass, i);
+			add_entity_overwrites(method, overwritten);
+		}
+		build_empty_graph(method);
+	}
+
+	classes[n_classes++] = klass;
+	return klass;
+}
+
+static void build_tree(ir_type *superclass, unsigned depth, unsigned fanout)
+{
+	if (depth == 0)
+		return;
+	for (unsigned i = 0; i < fanout; ++i) {
+		ir_type *klass = build_class(superclass, (unsigned)n_classes);
+		build_tree(klass, depth - 1, fanout);
+	}
+}
+
+static ir_entity *build_entry_point(ir_type *root)
+{
+	ir_entity *entry = new_entity(get_glob_type(), new_id_from_str("bench_main"), method_type);
+	ir_graph  *irg   = new_ir_graph(entry, 0);
+	ir_node   *block = get_r_cur_block(irg);
+	ir_node   *mem   = get_irg_initial_mem(irg);
+	ir_node   *obj   = new_r_Proj(get_irg_args(irg), mode_P, 0);
+
+	for (unsigned i = 0; i < n_methods; ++i) {
+		ir_entity *method = get_class_member(root, i);
+		ir_node   *sel    = new_r_MethodSel(block, mem, obj, method);
+		ir_node   *callee = new_r_Proj(sel, mode_P, pn_MethodSel_res);
+		mem = new_r_Proj(sel, mode_M, pn_MethodSel_M);
+		ir_node   *call   = new_r_Call(block, mem, callee, 1, &obj, method_type);
+		mem = new_r_Proj(call, mode_M, pn_Call_M);
+	}
+
+	ir_node *ret = new_r_Return(block, mem, 0, NULL);
+	add_immBlock_pred(get_irg_end_block(irg), ret);
+	irg_finalize_cons(irg);
+	return entry;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned depth  = argc > 1 ? (unsigned)atoi(argv[1]) : 6;
+	unsigned fanout = argc > 2 ? (unsigned)atoi(argv[2]) : 4;
+	n_methods       = argc > 3 ? (unsigned)atoi(argv[3]) : 8;
+
+	size_t max_classes = 1;
+	for (size_t level = 1, width = 1; level <= depth; ++level) {
+		width       *= fanout;
+		max_classes += width;
+	}
+
+	ir_init();
+	oo_init();
+
+	method_type = new_type_method(1, 0, false, cc_cdecl_set, mtp_no_property);
+	set_method_param_type(method_type, 0, new_type_pointer(new_type_primitive(mode_Is)));
+
+	classes = calloc(max_classes + 1, sizeof(*classes));
+	double start = now();
+	ir_type *root = build_class(NULL, 0);
+	build_tree(root, depth, fanout);
+	ir_entity *entry_points[] = { build_entry_point(root), NULL };
+	double built = now();
+
+	rta_optimization(entry_points, classes);
+	double analyzed = now();
+
+	printf("classes: %lu, methods: %lu\n", (unsigned long)n_classes, (unsigned long)(n_classes * n_methods));
+	printf("build: %.3f ms\n", (built - start) * 1e3);
+	printf("rta_optimization: %.3f ms\n", (analyzed - built) * 1e3);
+
+	free(classes);
+	oo_deinit();
+	ir_finish();
+	return 0;
+}
@@ -55,32 +55,111 @@ typedef enum {
 	bind_interface
 } ddispatch_binding;
 
+/*
+ * How interface calls are lowered. call_inline_cache may be combined with
+ * any of the other modes: every call site then gets a cache cell pointing to
+ * a (vtable, target) pair, see oo_set_inline_cache_size. Calls with a
+ * matching receiver vtable use the cached target, all others use the
+ * configured lookup and let the runtime update the cache, until the call
+ * site turns megamorphic. Calls in the start block are cached as well, the
+ * code of the start block is moved into a block of its own first.
+ * The runtime publishes a pair by storing its address in the cache cell
+ * after writing it. The call site loads the pair through that address, so
+ * the loads are ordered by their address dependency, which every supported
+ * target respects without a barrier.
+ *
+ * call_imt reserves DDISPATCH_IMT_SIZE vtable slots in front of the methods,
+ * indexed by a hash of the interface method. Slots shared by several
+ * interface methods of a class hold a pointer to a conflict table, which is
+ * searched by the runtime. A conflict mask in the slot before the IMT has
+ * the bits of these slots set. call_inline_cache is ignored for call_imt.
+ *
+ * call_row_displacement packs the interface methods of all classes into one
+ * global table: every interface method gets a column, every class a row
+ * base chosen so that rows do not overlap. The ITT slot of the vtable holds
+ * the address of the class' row. Every entry also holds the row address of
+ * its class, a call whose entry belongs to another class calls the abstract
+ * method entity instead. Needs the complete class hierarchy, see
+ * ddispatch_setup_dispatch_table, which rejects extern classes.
+ */
 typedef enum {
 	call_runtime_lookup = 0,
 	call_searched_itable = 1,
 	call_itable_indexed = 2,
-	call_move2front = 4
+	call_move2front = 4,
+	call_inline_cache = 8,
+	call_imt = 16,
+	call_row_displacement = 32
 } ddispatch_interface_call;
 
+#define DDISPATCH_IMT_SIZE 32
+
 
 typedef void     (*init_vtable_slots_t)           (ir_type* klass, ir_initializer_t *vtable_init, unsigned vtable_size);
 typedef ir_node* (*construct_interface_lookup_t)  (ir_node *objptr, ir_type *iface, ir_entity *method, ir_graph *irg, ir_node *block, ir_node **mem);
+/*
+ * Policy for guarded devirtualization: returns the implementation the
+ * dynamically bound call most likely reaches, or NULL. The call is then
+ * lowered to "if (vtable slot == target) call target else call slot", so
+ * the direct call can be inlined without a closed world assumption.
+ */
+typedef ir_entity* (*speculative_target_t)        (ir_node *call, ir_entity *method);
 
 void ddispatch_init(void);
 void ddispatch_deinit(void);
 void ddispatch_setup_vtable(ir_type *klass);
 void ddispatch_lower_Call(ir_node* call);
+void ddispatch_lower_deferred_calls(ir_graph *irg);
+/*
+ * Replaces call by a cascade comparing its callee with each of targets in
+ * order: a direct call for the first match and an indirect call through the
+ * original callee if none matches. Needs IR_RESOURCE_IRN_LINK and
+ * IR_RESOURCE_PHI_LIST with collected phi lists, and only applies to calls
+ * for which ddispatch_can_split_call holds. The callee may still be a
+ * MethodSel, ddispatch_lower_Call lowers it in the block of the MethodSel.
+ */
+bool ddispatch_can_split_call(ir_node *call);
+void ddispatch_split_call(ir_node *call, size_t n_targets, ir_entity *const *targets);
+int ddispatch_get_imt_slot(ir_entity *method);
 void ddispatch_prepare_new_instance(dbg_info *dbgi, ir_node *block, ir_node *objptr, ir_node **mem, ir_type* klass);
 
 void ddispatch_setup_itable(ir_type *klass);
+/*
+ * For call_itable_indexed: assigns ITT indices by coloring the interfaces,
+ * interfaces never implemented by the same class may share an index. Needs
+ * the complete class hierarchy and has to run before ddispatch_setup_itable.
+ * Returns the number of bytes saved in all ITTs compared to numbering the
+ * interfaces consecutively.
+ */
+size_t ddispatch_color_interfaces(void);
+
+/*
+ * For call_row_displacement: builds the global dispatch table from all
+ * classes. Has to run before ddispatch_setup_vtable. Panics if a class is
+ * extern, because its rows would live in another unit's table.
+ */
+void ddispatch_setup_dispatch_table(void);
+ir_initializer_t *ddispatch_get_dispatch_row_initializer(ir_type *klass);
+ir_node *ddispatch_interface_lookup_row_displacement(ir_node *objptr, ir_type *iface, ir_entity *method, ir_graph *irg, ir_node *block, ir_node **mem);
 int ddispatch_get_itable_method_index(ir_type *interface, ir_entity *method);
 ir_entity *ddispatch_get_itable_id(ir_type *interface);
 unsigned ddispatch_get_itable_index(ir_type *interface);
 ir_type *ddispatch_get_itt_entry_type(void);
 
 
+/*
+ * With embedded ITTs (see oo_set_embedded_itts) the itable slots are put in
+ * front of the given layout, the getters below return the shifted indices.
+ */
 void ddispatch_set_vtable_layout(unsigned vptr_points_to_index, unsigned index_of_first_method, unsigned index_of_rtti_ptr, init_vtable_slots_t func);
 void ddispatch_set_interface_lookup_constructor(construct_interface_lookup_t func);
+/* NULL (the default) disables guarded devirtualization */
+void ddispatch_set_speculative_target_callback(speculative_target_t func);
+/*
+ * A speculative_target_t returning the only non-abstract implementation of
+ * method among the classes currently known.
+ */
+ir_entity *ddispatch_speculate_single_implementation(ir_node *call, ir_entity *method);
 void ddispatch_set_abstract_method_entity(ir_entity *method);
 
 unsigned ddispatch_get_vptr_points_to_index(void);
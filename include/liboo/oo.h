@@ -14,9 +14,96 @@ void oo_lower(void);
 void oo_set_interface_call_type(ddispatch_interface_call type);
 ddispatch_interface_call oo_get_interface_call_type(void);
 
+/*
+ * Number of (vtable, target) pairs cached per call site with
+ * call_inline_cache. The default of 1 is a monomorphic cache, which is
+ * refilled on a miss a few times. Larger caches are filled by the runtime.
+ * A call site missing more often permanently uses the configured interface
+ * lookup without calling into the runtime.
+ */
+void oo_set_inline_cache_size(unsigned size);
+unsigned oo_get_inline_cache_size(void);
+
+/*
+ * If enabled, call sites with call_inline_cache count hits of their inline
+ * checked pair for oo_rt_dump_inline_cache_stats. The counter is updated
+ * without synchronization, so it is only an estimate with multiple threads.
+ */
+void oo_set_inline_cache_stats(bool enable);
+bool oo_get_inline_cache_stats(void);
+
+/*
+ * If enabled, oo_lower compresses the ITTs of call_itable_indexed by
+ * letting interfaces that are never implemented together share an index
+ * (see ddispatch_color_interfaces).
+ */
+void oo_set_interface_coloring(bool enable);
+bool oo_get_interface_coloring(void);
+
+/*
+ * If enabled, the method slots of vtables (including the IMT) hold the
+ * offset of their target relative to the address the vptr points to
+ * instead of an absolute pointer. These are resolved by the static linker,
+ * so vtables need no dynamic relocations for their methods.
+ * This only covers the method slots: they stay pointer-sized, and the rtti
+ * and ITT pointers in the vtable, itables, ITTs and the rtti stay absolute
+ * and still need relocations. Methods of extern classes and runtime
+ * functions are reached through private stubs. In shared objects all other
+ * methods must not be preemptible (e.g. hidden visibility or -Bsymbolic).
+ */
+void oo_set_relative_vtables(bool enable);
+bool oo_get_relative_vtables(void);
+
+/*
+ * Number of itable pointer slots placed in front of every vtable with
+ * call_itable_indexed. The itable of the interface with ITT index i is then
+ * found at offset -(i+1) of the vptr target, saving the load of the ITT
+ * pointer on interface calls. Interfaces with an index of n_slots or more
+ * are still looked up through the ITT. Every vtable grows by n_slots
+ * pointers, so keep this small. Has to be set before oo_init because it
+ * fixes the vtable layout. The default of 0 disables embedding.
+ */
+void oo_set_embedded_itts(unsigned n_slots);
+unsigned oo_get_embedded_itts(void);
+
+/*
+ * Promise that the program is complete: no classes besides the known ones
+ * are loaded at runtime. oo_lower then infers final classes and methods
+ * (see oo_infer_final) before lowering.
+ */
+void oo_set_closed_world(bool enable);
+bool oo_get_closed_world(void);
+
+/*
+ * If enabled, oo_lower assigns preorder uids, a preorder numbering of the
+ * (single inheritance) class tree starting at 1. Each class then also knows
+ * the largest preorder uid of its subclasses, so a subclass test is a check
+ * for uid <= subclass uid <= max subclass uid. The class uids set by the
+ * frontend are kept.
+ * This requires the whole class hierarchy to be known when lowering.
+ */
+void oo_set_preorder_class_uids(bool enable);
+bool oo_get_preorder_class_uids(void);
+/*
+ * Assign preorder class uids right away, e.g. to make them available to
+ * optimizations running before oo_lower.
+ */
+void oo_assign_preorder_class_uids(void);
+
 
 unsigned oo_get_class_uid(ir_type *classtype);
 void oo_set_class_uid(ir_type *classtype, unsigned uid);
+unsigned oo_get_class_preorder_uid(ir_type *classtype);
+void oo_set_class_preorder_uid(ir_type *classtype, unsigned uid);
+unsigned oo_get_class_max_subclass_uid(ir_type *classtype);
+void oo_set_class_max_subclass_uid(ir_type *classtype, unsigned uid);
+/*
+ * Preorder uids are only comparable between classes numbered together, i.e.
+ * with the same (nonzero) preorder numbering. Each run of
+ * oo_assign_preorder_class_uids uses a new one.
+ */
+unsigned oo_get_class_preorder_numbering(ir_type *classtype);
+void oo_set_class_preorder_numbering(ir_type *classtype, unsigned numbering);
 ir_entity *oo_get_class_vtable_entity(ir_type *classtype);
 void oo_set_class_vtable_entity(ir_type *classtype, ir_entity *vtable);
 unsigned oo_get_class_vtable_size(ir_type *classtype);
@@ -63,6 +150,11 @@ bool oo_get_call_is_statically_bound(ir_node *call);
 
 ir_type *oo_get_class_superclass(ir_type *klass);
 ir_entity *oo_get_entity_overwritten_superclass_entity(ir_entity *entity);
+/*
+ * Returns the method whose code is run for method: inherited methods are
+ * followed up to the superclass implementing them.
+ */
+ir_entity *oo_get_method_implementation(ir_entity *method);
 
 void oo_copy_entity_info(ir_entity *src, ir_entity *dest);
 
@@ -1,10 +1,32 @@
 #ifndef OO_OPT_H
 #define OO_OPT_H
 
+#include <stddef.h>
+
 /**
  * register transform_Node/equivalent_node/computed_value optimization
  * callbacks for liboo specific nodes.
  */
 void oo_register_opt_funcs(void);
 
+/**
+ * Marks dynamically bound calls as statically bound if class hierarchy
+ * analysis proves a single target: the method or its class is final, or
+ * the method is not overridden and neither its class nor any of its
+ * subclasses is extern. Unlike rta_optimization this needs no entry points,
+ * it only assumes that non-extern classes are not subclassed by code
+ * unknown to the compiler. Run before oo_lower.
+ * @return number of calls bound statically
+ */
+size_t oo_cha_devirtualize(void);
+
+/**
+ * Closed world only: marks all leaf classes that are neither interfaces nor
+ * extern and all methods of non-extern classes that are never overridden as
+ * final, so oo_lower binds more calls statically. oo_lower runs this itself
+ * if oo_set_closed_world is enabled.
+ * @return number of classes and methods newly marked final
+ */
+size_t oo_infer_final(void);
+
 #endif
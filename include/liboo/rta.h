@@ -14,6 +14,7 @@
 #define OO_RTA_H
 
 
+#include <stdbool.h>
 #include <libfirm/firm.h>
 
 /** sets important callback functions needed to detect calls (e.g. class intialization) hidden behind frontend-specific nodes
@@ -25,6 +26,18 @@
  */
 void rta_set_detection_callbacks(ir_entity *(*detect_call)(ir_node *call));
 
+/** sets the maximum number of potential targets for which a dynamically bound call is split into a type-switch of direct calls with an indirect call as fallback, so the targets can be inlined
+ * @note Calls with exactly one target are devirtualized regardless of this setting, a limit of 1 (the default) disables type-switches.
+ * @param limit give maximum size of the target set
+ */
+void rta_set_type_switch_limit(unsigned limit);
+
+/** selects a more precise variant of the analysis that keeps a set of classes per method and field (XTA) instead of one set of live classes for the whole program
+ * @note Classes then only reach the calls in methods they can flow to along calls, returns and field accesses, so more calls get a single target. Objects exchanged with external code, arrays and static fields are still merged into one set.
+ * @param enable give true to use per-method type sets, default is false
+ */
+void rta_set_per_method_type_sets(bool enable);
+
 
 /** runs Rapid Type Analysis and then tries to devirtualize dynamically bound calls and to discard unneeded classes and methods
  * @note RTA requires object creations to be marked with VptrIsSet nodes.
@@ -33,6 +46,7 @@ void rta_set_detection_callbacks(ir_entity *(*detect_call)(ir_node *call));
  * @note RTA also won't work with programs that dynamically load classes at runtime or use generic object creation (like Java Class.newInstance)! It can lead to defective programs!
  * @note Give classes that are instantiated in native methods of a nonexternal standard library or runtime as initial_live_classes, give methods called in these native methods as additional entry points. If something is missing, RTA could produce defective programs! This also means that native methods in the program that do arbitrary things are not supported as long as there is no way to tell RTA what classes are instantiated and what methods are called in all those native methods.
  * @note C++ is currently not supported (C++ constructor semantics, function pointers, ...).
+ * @note Run it before oo_lower. Unused classes lose their vtable, itt and rtti entity, the entities are freed (so a frontend-specific runtime typeinfo constructor has to skip classes without rtti entity), graphs of unused methods are freed (the methods stay as mere declarations) and their vtable slots refer to the abstract method error instead.
  * @param entry_points NULL-terminated array of method entities, give all entry points to program code, may _not_ be NULL and must contain at least one method entity, also all entry points should have a graph
  * @param initial_live_classes NULL-terminated array of classes that should always be considered live, may be NULL
  */
@@ -17,6 +17,15 @@ typedef struct {
 	char     data[];
 } string_const_t;
 
+/**
+ * Number of superclass display entries stored inline in class_info_t.
+ * Classes nested deeper than this are still handled correctly, subtype tests
+ * against them take a slower path walking the superclass chain.
+ */
+#define OO_CLASS_DISPLAY_SIZE    8
+/** depth value of interfaces, which are not part of any superclass display */
+#define OO_CLASS_DEPTH_INTERFACE UINT32_MAX
+
 typedef struct {
 	string_const_t *name; /* including signature */
 	void           *funcptr;
@@ -31,6 +40,32 @@ struct class_info_t {
 	method_info_t        *methods;
 	uint32_t              n_interfaces;
 	struct class_info_t **interfaces;
+	uint32_t              depth;   /* number of superclasses */
+	/* display[i] is the superclass at depth i (display[depth] is the class
+	 * itself), unused entries are NULL */
+	const struct class_info_t *display[OO_CLASS_DISPLAY_SIZE];
+	/* position in a preorder numbering of the class tree and the largest
+	 * preorder uid in the subtree of this class (see
+	 * oo_set_preorder_class_uids), both 0 if the class is not numbered */
+	uint32_t              preorder_uid;
+	uint32_t              max_subclass_uid;
+	/* preorder uids of two classes are only comparable if this is equal,
+	 * NULL if the class is not numbered */
+	const void           *preorder_numbering;
+	/* dense index of an interface (only valid for interfaces) */
+	uint32_t              interface_index;
+	/* bitset of the indices of all (transitively) implemented interfaces,
+	 * never NULL */
+	uint32_t              n_interface_words;
+	const uint32_t       *interface_bits;
+	/* interface indices are assigned per compilation unit, index and
+	 * bitsets of two classes are only comparable if this is equal */
+	const void           *interface_numbering;
+	/* open addressed hash table (linear probing on the name hash) of all
+	 * methods including inherited ones, empty slots have a NULL name.
+	 * The size is a power of two (or 0 if there are no methods). */
+	uint32_t              method_index_size;
+	method_info_t        *method_index;
 };
 typedef struct class_info_t class_info_t;
 
@@ -44,6 +79,16 @@ typedef struct {
 	lsda_entry_t entries[1];
 } lsda_t;
 
+/** checks whether bit @p index is set in an interface bitset */
+inline static bool interface_bits_contain(const uint32_t *bits,
+                                          uint32_t n_words, uint32_t index)
+{
+	uint32_t word = index / 32;
+	if (word >= n_words)
+		return false;
+	return (bits[word] >> (index % 32)) & 1;
+}
+
 inline static const char *get_string_const_chars(const string_const_t *s)
 {
 	return s->data;
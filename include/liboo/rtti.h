@@ -8,11 +8,29 @@ typedef ir_node *(*construct_instanceof_t)       (ir_node *objptr, ir_type *klas
 
 void     rtti_default_construct_runtime_typeinfo(ir_type *klass);
 ir_node *rtti_default_construct_instanceof(ir_node *objptr, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem);
+/**
+ * Alternative instanceof lowering, select it with
+ * rtti_set_instanceof_constructor(). Tests against classes are expanded
+ * directly in the IR into a compare of the object's classinfo (final classes)
+ * or a compare of the object's superclass display. Tests against interfaces
+ * check a bit in the object's interface bitset and tests against classes
+ * nested deeper than OO_CLASS_DISPLAY_SIZE check the preorder uid range, both
+ * only if the object's class was numbered by this compilation unit, and call
+ * the runtime otherwise. As this needs control flow, rtti_lower_InstanceOf
+ * defers them to rtti_lower_deferred_instanceofs(). Deep classes without
+ * preorder uids still call the runtime.
+ */
+ir_node *rtti_inline_construct_instanceof(ir_node *objptr, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem);
 
 void rtti_init(void);
 void rtti_deinit(void);
 void rtti_construct_runtime_typeinfo(ir_type *klass);
 void rtti_lower_InstanceOf(ir_node *instanceof);
+/**
+ * Lowers the InstanceOf nodes of irg that rtti_lower_InstanceOf deferred
+ * because they need control flow. Call it after walking irg.
+ */
+void rtti_lower_deferred_instanceofs(ir_graph *irg);
 void rtti_set_runtime_typeinfo_constructor(construct_runtime_typeinfo_t func);
 void rtti_set_instanceof_constructor(construct_instanceof_t func);
 
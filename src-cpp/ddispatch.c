@@ -3,6 +3,8 @@
 #include "liboo/rtti.h"
 #include "liboo/dmemory.h"
 #include "liboo/nodes.h"
+#include "liboo/rts_types.h"
+#include "table_pool.h"
 
 #include <assert.h>
 #include "adt/error.h"
@@ -11,6 +13,10 @@
 #include "adt/cpset.h"
 #include "adt/cpmap.h"
 #include "adt/hashptr.h"
+#include "adt/pdeq.h"
+#include "adt/raw_bitset.h"
+
+#include <string.h>
 
 #include <libfirm/ident.h>
 
@@ -18,12 +24,37 @@ static ir_mode   *mode_reference;
 static ir_type   *type_reference;
 static ir_mode   *mode_int;
 static ir_type   *type_int;
+static ir_type   *type_uint;
 static ir_type   *type_char;
 
 static ir_type *itt_entry_type = NULL;
 
 static ir_entity *default_lookup_interface_entity;
 static ir_entity *searched_itable_interface_entity;
+static ir_entity *inline_cache_update_entity;
+static ir_entity *polymorphic_cache_lookup_entity;
+static ir_entity *polymorphic_cache_update_entity;
+
+static ir_type   *inline_cache_type = NULL;
+static ir_entity *inline_cache_first;
+static ir_entity *inline_cache_n_used;
+static ir_entity *inline_cache_hits;
+static ir_entity *inline_cache_vtable;
+static ir_entity *inline_cache_target;
+static ir_entity *inline_cache_empty;
+
+static ir_entity *imt_resolve_entity;
+static ir_type   *imt_conflict_type = NULL;
+
+static ir_entity *dispatch_table = NULL;
+static ir_entity *dispatch_entry_owner;
+static ir_entity *dispatch_entry_target;
+
+/* calls waiting for ddispatch_lower_deferred_calls, each followed by its
+ * speculative target (NULL if it is not a guarded call) */
+static pdeq *deferred_calls;
+/* whether one of them is in the start block, which part_block can't split */
+static bool deferred_in_start_block;
 
 struct ddispatch_model_t {
 	unsigned                      vptr_points_to_index;
@@ -33,6 +64,7 @@ struct ddispatch_model_t {
 	init_vtable_slots_t           init_vtable_slots;
 	ir_entity                    *abstract_method_entity;
 	construct_interface_lookup_t  construct_interface_lookup;
+	speculative_target_t          speculative_target;
 } ddispatch_model;
 
 typedef struct ddispatch_klass_iterator_t ddispatch_klass_iterator_t;
@@ -55,7 +87,14 @@ static struct obstack ddispatch_obst;
 
 static cpmap_t interface_index_map;
 static cpmap_t it_index_map;
+static cpmap_t interface_color_map;
+static cpmap_t selector_map;
+static cpmap_t row_base_map;
+static cpmap_t local_stub_map;
+static table_pool_t itable_pool;
 static unsigned interface_index;
+/* number of itable slots in front of every vtable, see oo_set_embedded_itts */
+static unsigned n_embedded_itt_slots;
 
 typedef struct {
 	ir_type   *interface;
@@ -69,11 +108,43 @@ typedef struct {
 	int        index;
 } it_index_map_entry;
 
+/* the configured lookup mechanism, without the inline cache flag */
+static ddispatch_interface_call get_interface_lookup_type(void)
+{
+	return oo_get_interface_call_type() & ~call_inline_cache;
+}
+
+/* moves the address point of the vtable layout behind n_slots itable pointer slots */
+static void embed_itt_slots(unsigned n_slots)
+{
+	n_embedded_itt_slots = n_slots;
+	ddispatch_model.vptr_points_to_index  += n_slots;
+	ddispatch_model.index_of_rtti_ptr     += n_slots;
+	ddispatch_model.index_of_itt_ptr      += n_slots;
+	ddispatch_model.index_of_first_method += n_slots;
+}
+
+static bool uses_itt(void)
+{
+	ddispatch_interface_call type = get_interface_lookup_type();
+	return (type & call_searched_itable) == call_searched_itable
+	    || type == call_itable_indexed;
+}
+
 static interface_index_entry *get_itt_entry(ir_type *klass)
 {
 	return cpmap_find(&interface_index_map, klass);
 }
 
+/*
+ * Searched ITTs are sorted by this key, the runtime binary searches the keys
+ * and compares the interface ids only for entries with a matching key.
+ */
+static uint32_t get_itt_key(ir_type *interface)
+{
+	return string_hash(get_compound_name(interface));
+}
+
 static void *combine_ptr_hash(void *p1, void *p2)
 {
 	return (void*)(size_t)HASH_COMBINE(hash_ptr(p1), hash_ptr(p2));
@@ -150,13 +221,16 @@ static void default_init_vtable_slots(ir_type* klass, ir_initializer_t *vtable_i
 	ir_initializer_t *ci_init   = create_initializer_const(ci_symc);
 	set_initializer_compound_value(vtable_init, ddispatch_model.index_of_rtti_ptr, ci_init);
 
-	if (oo_get_interface_call_type() != call_runtime_lookup) {
+	if (uses_itt()) {
 		ir_entity        *itt       = oo_get_class_itt_entity(klass);
 		assert(itt);
 
 		ir_node          *itt_symc  = new_r_Address(ccode_irg, itt);
 		ir_initializer_t *itt_init  = create_initializer_const(itt_symc);
 		set_initializer_compound_value(vtable_init, ddispatch_model.index_of_itt_ptr, itt_init);
+	} else if (get_interface_lookup_type() == call_row_displacement) {
+		ir_initializer_t *row_init  = ddispatch_get_dispatch_row_initializer(klass);
+		set_initializer_compound_value(vtable_init, ddispatch_model.index_of_itt_ptr, row_init);
 	}
 
 	ir_node          *const_0   = new_r_Const_long(ccode_irg, mode_reference, 0);
@@ -169,6 +243,33 @@ static void default_init_vtable_slots(ir_type* klass, ir_initializer_t *vtable_i
 	}
 }
 
+/*
+ * Loads the vtable address of objptr. The vptr is set once by
+ * ddispatch_prepare_new_instance and never changes afterwards, so later
+ * memory operations need not be ordered after this load and the memory
+ * result is dropped.
+ */
+static ir_node *load_vtable_address(ir_node *block, ir_node *mem, ir_node *objptr, ir_type *classtype)
+{
+	ir_entity *vptr_entity = oo_get_class_vptr_entity(classtype);
+	ir_type   *vptr_type   = get_entity_type(vptr_entity);
+	ir_node   *vptr_addr   = new_r_Member(block, objptr, vptr_entity);
+	ir_node   *vptr_load   = new_r_Load(block, mem, vptr_addr, mode_reference, vptr_type, cons_none);
+	return new_r_Proj(vptr_load, mode_reference, pn_Load_res);
+}
+
+/*
+ * Vtables, ITTs, itables and the dispatch table are never written, loads
+ * from them use the initial memory and may float, so they can be hoisted
+ * out of loops and shared between calls.
+ */
+static ir_node *new_immutable_load(ir_node *block, ir_node *ptr, ir_mode *mode, ir_type *type)
+{
+	ir_graph *irg  = get_irn_irg(block);
+	ir_node  *load = new_r_Load(block, get_irg_initial_mem(irg), ptr, mode, type, cons_floats);
+	return new_r_Proj(load, mode, pn_Load_res);
+}
+
 static ir_node *default_interface_lookup_method(ir_node *objptr, ir_type *iface, ir_entity *method, ir_graph *irg, ir_node *block, ir_node **mem)
 {
 	ir_node    *cur_mem        = *mem;
@@ -177,19 +278,14 @@ static ir_node *default_interface_lookup_method(ir_node *objptr, ir_type *iface,
 	// first, dereference the vptr in order to get the vtable address.
 	ir_entity  *vptr_entity    = oo_get_class_vptr_entity(iface);
 	ir_type    *vptr_type      = get_entity_type(vptr_entity);
-	ir_node    *vptr_addr      = new_r_Member(block, objptr, vptr_entity);
-	ir_node    *vptr_load      = new_r_Load(block, cur_mem, vptr_addr, mode_P, vptr_type, cons_none);
-	ir_node    *vtable_addr    = new_r_Proj(vptr_load, mode_P, pn_Load_res);
-	            cur_mem        = new_r_Proj(vptr_load, mode_M, pn_Load_M);
+	ir_node    *vtable_addr    = load_vtable_address(block, cur_mem, objptr, iface);
 
 	// second, calculate the position of the RTTI ref in relation to the target of vptr and dereference it.
 	int         offset         = (ddispatch_model.index_of_rtti_ptr - ddispatch_model.vptr_points_to_index) * get_type_size(type_reference);
 	ir_mode    *mode_offset    = get_reference_offset_mode(mode_P);
 	ir_node    *ci_offset      = new_r_Const_long(irg, mode_offset, offset);
 	ir_node    *ci_add         = new_r_Add(block, vtable_addr, ci_offset);
-	ir_node    *ci_load        = new_r_Load(block, cur_mem, ci_add, mode_P, vptr_type, cons_none);
-	ir_node    *ci_ref         = new_r_Proj(ci_load, mode_P, pn_Load_res);
-	            cur_mem        = new_r_Proj(ci_load, mode_M, pn_Load_M);
+	ir_node    *ci_ref         = new_immutable_load(block, ci_add, mode_P, vptr_type);
 
 	const char *method_name    = get_entity_name(method);
 	ir_entity  *name_const_ent = rtti_emit_string_const(method_name);
@@ -211,9 +307,6 @@ static ir_node *default_interface_lookup_method(ir_node *objptr, ir_type *iface,
 
 static ir_node *interface_lookup_indexed(ir_node *objptr, ir_type *iface, ir_entity *method, ir_graph *irg, ir_node *block, ir_node **mem)
 {
-	ir_node *new_mem = *mem;
-	ir_node *new_res;
-
 	ir_type *classtype = get_entity_owner(method);
 	assert(is_Class_type(classtype));
 
@@ -226,7 +319,6 @@ static ir_node *interface_lookup_indexed(ir_node *objptr, ir_type *iface, ir_ent
 
 	ir_entity *vptr_entity  = oo_get_class_vptr_entity(classtype);
 	ir_type   *vptr_type    = get_entity_type(vptr_entity);
-	ir_node   *vptr         = new_r_Member(block, objptr, vptr_entity);
 
 	ir_type   *type_unknown = get_unknown_type();
 	ir_type   *itt_type     = type_unknown;
@@ -235,39 +327,33 @@ static ir_node *interface_lookup_indexed(ir_node *objptr, ir_type *iface, ir_ent
 	ir_mode *mode_offset    = get_reference_offset_mode(mode_reference);
 
 	// Load vtable
-	ir_node   *vtable_load  = new_r_Load(block, *mem, vptr, mode_reference, vptr_type, cons_none);
-	ir_node   *vtable_addr  = new_r_Proj(vtable_load, mode_reference, pn_Load_res);
-	ir_node   *vtable_mem   = new_r_Proj(vtable_load, mode_M, pn_Load_M);
-
-
-	// Compute and load ITT address
-	ir_node   *itt_offset   = new_r_Const_long(irg, mode_offset, 1 * type_ref_size);
-	ir_node   *itt_ptr_addr = new_r_Add(block, vtable_addr, itt_offset);
-
-	ir_node   *itt_load     = new_r_Load(block, vtable_mem, itt_ptr_addr, mode_reference, itt_type, cons_none);
-	ir_node   *itt_addr     = new_r_Proj(itt_load, mode_reference, pn_Load_res);
-	ir_node   *itt_mem      = new_r_Proj(itt_load, mode_M, pn_Load_M);
-
-	// Compute and load itable address
-	unsigned   entry_size   = get_type_size(ddispatch_get_itt_entry_type());
+	ir_node   *vtable_addr  = load_vtable_address(block, *mem, objptr, classtype);
 	unsigned   it_id        = ddispatch_get_itable_index(iface);
-	ir_node   *it_offset    = new_r_Const_long(irg, mode_offset, it_id * entry_size);
-	ir_node   *it_ptr_addr  = new_r_Add(block, itt_addr, it_offset);
 
-	ir_node   *it_load      = new_r_Load(block, itt_mem, it_ptr_addr, mode_reference, vptr_type, cons_none);
-	ir_node   *it_addr      = new_r_Proj(it_load, mode_reference, pn_Load_res);
-	ir_node   *it_mem       = new_r_Proj(it_load, mode_M, pn_Load_M);
+	ir_node   *it_ptr_addr;
+	if (it_id < n_embedded_itt_slots) {
+		// itable pointers are in front of the vtable
+		long       it_offset    = -(long)(it_id + 1) * type_ref_size;
+		ir_node   *it_off_node  = new_r_Const_long(irg, mode_offset, it_offset);
+		it_ptr_addr             = new_r_Add(block, vtable_addr, it_off_node);
+	} else {
+		// Compute and load ITT address
+		int        itt_index    = ddispatch_model.index_of_itt_ptr - ddispatch_model.vptr_points_to_index;
+		ir_node   *itt_offset   = new_r_Const_long(irg, mode_offset, itt_index * (int)type_ref_size);
+		ir_node   *itt_ptr_addr = new_r_Add(block, vtable_addr, itt_offset);
+		ir_node   *itt_addr     = new_immutable_load(block, itt_ptr_addr, mode_reference, itt_type);
+
+		// Compute itable address
+		unsigned   entry_size   = get_type_size(ddispatch_get_itt_entry_type());
+		ir_node   *it_offset    = new_r_Const_long(irg, mode_offset, it_id * entry_size);
+		it_ptr_addr             = new_r_Add(block, itt_addr, it_offset);
+	}
+	ir_node   *it_addr      = new_immutable_load(block, it_ptr_addr, mode_reference, vptr_type);
 
 	// Call method
 	ir_node *vtable_offset  = new_r_Const_long(irg, mode_offset, itable_id * type_ref_size);
 	ir_node *funcptr_addr   = new_r_Add(block, it_addr, vtable_offset);
-	ir_node *callee_load    = new_r_Load(block, it_mem, funcptr_addr, mode_reference, vptr_type, cons_none);
-	new_res                 = new_r_Proj(callee_load, mode_reference, pn_Load_res);
-	new_mem                 = new_r_Proj(callee_load, mode_M, pn_Load_M);
-
-	mem = &new_mem;
-
-	return new_res;
+	return new_immutable_load(block, funcptr_addr, mode_reference, vptr_type);
 }
 
 static ir_node *interface_lookup_searched_itable(ir_node *objptr, ir_type *iface, ir_entity *method, ir_graph *irg, ir_node *block, ir_node **mem)
@@ -285,14 +371,15 @@ static ir_node *interface_lookup_searched_itable(ir_node *objptr, ir_type *iface
 
 	ir_node   *callee        = new_r_Address(irg, searched_itable_interface_entity);
 	ir_node   *interface_ref = new_r_Address(irg, interface_id);
+	ir_node   *interface_key = new_r_Const_long(irg, mode_Iu, get_itt_key(iface));
 
 	ir_mode *mode_offset     = get_reference_offset_mode(mode_reference);
 	ir_node *itable_offset   = new_r_Const_long(irg, mode_offset, itable_index);
 
 	// Call method
-	ir_node   *args[3]       = { objptr, interface_ref, itable_offset};
+	ir_node   *args[4]       = { objptr, interface_ref, interface_key, itable_offset};
 	ir_type   *call_type     = get_entity_type(searched_itable_interface_entity);
-	ir_node   *call          = new_r_Call(block, cur_mem, callee, 3, args, call_type);
+	ir_node   *call          = new_r_Call(block, cur_mem, callee, 4, args, call_type);
 	cur_mem                  = new_r_Proj(call, mode_M, pn_Call_M);
 	ir_node   *ress          = new_r_Proj(call, mode_T, pn_Call_T_result);
 	ir_node   *res           = new_r_Proj(ress, mode_P, 0);
@@ -302,12 +389,62 @@ static ir_node *interface_lookup_searched_itable(ir_node *objptr, ir_type *iface
 	return res;
 }
 
+ir_node *ddispatch_interface_lookup_row_displacement(ir_node *objptr, ir_type *iface, ir_entity *method, ir_graph *irg, ir_node *block, ir_node **mem)
+{
+	void *selector = cpmap_find(&selector_map, method);
+	if (selector == NULL || dispatch_table == NULL)
+		return default_interface_lookup_method(objptr, iface, method, irg, block, mem);
+
+	ir_type   *classtype     = get_entity_owner(method);
+	ir_entity *vptr_entity   = oo_get_class_vptr_entity(classtype);
+	ir_type   *vptr_type     = get_entity_type(vptr_entity);
+
+	unsigned   type_ref_size = get_type_size(type_reference);
+	ir_mode   *mode_offset   = get_reference_offset_mode(mode_reference);
+
+	// load vtable
+	ir_node   *vtable_addr   = load_vtable_address(block, *mem, objptr, classtype);
+
+	// load the class' row of the dispatch table
+	int        row_index     = ddispatch_model.index_of_itt_ptr - ddispatch_model.vptr_points_to_index;
+	ir_node   *row_offset    = new_r_Const_long(irg, mode_offset, row_index * (int)type_ref_size);
+	ir_node   *row_ptr_addr  = new_r_Add(block, vtable_addr, row_offset);
+	ir_node   *row_addr      = new_immutable_load(block, row_ptr_addr, mode_reference, vptr_type);
+
+	// load the entry in the selector's column
+	ir_type   *entry_type    = get_entity_owner(dispatch_entry_target);
+	long       column        = (PTR_TO_INT(selector) - 1) * get_type_size(entry_type);
+	ir_node   *column_offset = new_r_Const_long(irg, mode_offset, column);
+	ir_node   *entry_addr    = new_r_Add(block, row_addr, column_offset);
+	ir_node   *owner_addr    = new_r_Member(block, entry_addr, dispatch_entry_owner);
+	ir_node   *owner         = new_immutable_load(block, owner_addr, mode_reference, vptr_type);
+	ir_node   *funcptr_addr  = new_r_Member(block, entry_addr, dispatch_entry_target);
+	ir_node   *funcptr       = new_immutable_load(block, funcptr_addr, mode_reference, vptr_type);
+
+	// class check: the entry has to belong to the receiver's row, otherwise
+	// the class does not implement the method
+	ir_node   *cmp           = new_r_Cmp(block, owner, row_addr, ir_relation_equal);
+	ir_node   *error         = new_r_Address(irg, ddispatch_model.abstract_method_entity);
+	return new_r_Mux(block, cmp, error, funcptr);
+}
+
 void ddispatch_deinit(void)
 {
 	obstack_free(&ddispatch_obst, NULL);
 
 	cpmap_destroy(&interface_index_map);
 	cpmap_destroy(&it_index_map);
+	cpmap_destroy(&interface_color_map);
+	cpmap_destroy(&selector_map);
+	cpmap_destroy(&row_base_map);
+	cpmap_destroy(&local_stub_map);
+	table_pool_destroy(&itable_pool);
+
+	del_pdeq(deferred_calls);
+	inline_cache_type  = NULL;
+	inline_cache_empty = NULL;
+	imt_conflict_type  = NULL;
+	dispatch_table    = NULL;
 }
 
 
@@ -319,16 +456,25 @@ void ddispatch_init(void)
 	type_char = new_type_primitive(mode_char);
 	mode_int = new_int_mode("I", 32, 1, 32);
 	type_int = new_type_primitive(mode_int);
+	type_uint = new_type_primitive(mode_Iu);
 	ir_mode *mode_offset = get_reference_offset_mode(mode_reference);
 	ir_type *type_offset = new_type_primitive(mode_offset);
 
 	interface_index = 0;
+	n_embedded_itt_slots = 0;
 
 	cpmap_init(&interface_index_map, hash_ptr, ptr_equals);
 	cpmap_init(&it_index_map, hash_ptr, ptr_equals);
+	cpmap_init(&interface_color_map, hash_ptr, ptr_equals);
+	cpmap_init(&selector_map, hash_ptr, ptr_equals);
+	cpmap_init(&row_base_map, hash_ptr, ptr_equals);
+	cpmap_init(&local_stub_map, hash_ptr, ptr_equals);
+	table_pool_init(&itable_pool);
 
 	obstack_init(&ddispatch_obst);
 
+	deferred_calls = new_pdeq();
+
 	ir_type   *abstract_type   = new_type_method(0, 0, false, cc_cdecl_set, mtp_no_property);
 	ident     *abstract_ident  = new_id_from_str("oo_rt_abstract_method_error");
 	ir_entity *abstract_entity
@@ -340,10 +486,15 @@ void ddispatch_init(void)
 	ddispatch_model.index_of_itt_ptr       = 1;
 	ddispatch_model.init_vtable_slots      = default_init_vtable_slots;
 	ddispatch_model.abstract_method_entity = abstract_entity;
+	ddispatch_model.speculative_target     = NULL;
+	if (get_interface_lookup_type() == call_itable_indexed)
+		embed_itt_slots(oo_get_embedded_itts());
 	if ((oo_get_interface_call_type() & call_searched_itable) == call_searched_itable)
 		ddispatch_model.construct_interface_lookup = interface_lookup_searched_itable;
-	else if (oo_get_interface_call_type() == call_itable_indexed)
+	else if (get_interface_lookup_type() == call_itable_indexed)
 		ddispatch_model.construct_interface_lookup = interface_lookup_indexed;
+	else if (get_interface_lookup_type() == call_row_displacement)
+		ddispatch_model.construct_interface_lookup = ddispatch_interface_lookup_row_displacement;
 	else
 		ddispatch_model.construct_interface_lookup  = default_interface_lookup_method;
 
@@ -357,10 +508,11 @@ void ddispatch_init(void)
 		= create_compilerlib_entity(default_li_ident, default_li_type);
 
 	// Searched Itable Lookup
-	ir_type *si_li_type = new_type_method(3, 1, false, cc_cdecl_set, mtp_no_property);
+	ir_type *si_li_type = new_type_method(4, 1, false, cc_cdecl_set, mtp_no_property);
 	set_method_param_type(si_li_type, 0, type_reference);
 	set_method_param_type(si_li_type, 1, type_reference);
-	set_method_param_type(si_li_type, 2, type_offset);
+	set_method_param_type(si_li_type, 2, type_uint);
+	set_method_param_type(si_li_type, 3, type_offset);
 	set_method_res_type(si_li_type, 0, type_reference);
 	ident *si_li_ident;
 	if ((oo_get_interface_call_type() & call_move2front) == call_move2front) {
@@ -370,6 +522,37 @@ void ddispatch_init(void)
 	}
 	searched_itable_interface_entity
 		= create_compilerlib_entity(si_li_ident, si_li_type);
+
+	// Inline cache update
+	ir_type *ic_update_type = new_type_method(3, 0, false, cc_cdecl_set, mtp_no_property);
+	set_method_param_type(ic_update_type, 0, type_reference);
+	set_method_param_type(ic_update_type, 1, type_reference);
+	set_method_param_type(ic_update_type, 2, type_reference);
+	ident *ic_update_ident = new_id_from_str("oo_rt_inline_cache_update");
+	inline_cache_update_entity
+		= create_compilerlib_entity(ic_update_ident, ic_update_type);
+
+	// Polymorphic inline cache
+	ir_type *pic_lookup_type = new_type_method(2, 1, false, cc_cdecl_set, mtp_no_property);
+	set_method_param_type(pic_lookup_type, 0, type_reference);
+	set_method_param_type(pic_lookup_type, 1, type_reference);
+	set_method_res_type(pic_lookup_type, 0, type_reference);
+	ident *pic_lookup_ident = new_id_from_str("oo_rt_polymorphic_cache_lookup");
+	polymorphic_cache_lookup_entity
+		= create_compilerlib_entity(pic_lookup_ident, pic_lookup_type);
+
+	ident *pic_update_ident = new_id_from_str("oo_rt_polymorphic_cache_update");
+	polymorphic_cache_update_entity
+		= create_compilerlib_entity(pic_update_ident, ic_update_type);
+
+	// IMT conflict resolution
+	ir_type *imt_resolve_type = new_type_method(2, 1, false, cc_cdecl_set, mtp_no_property);
+	set_method_param_type(imt_resolve_type, 0, type_reference);
+	set_method_param_type(imt_resolve_type, 1, type_reference);
+	set_method_res_type(imt_resolve_type, 0, type_reference);
+	ident *imt_resolve_ident = new_id_from_str("oo_rt_imt_resolve");
+	imt_resolve_entity
+		= create_compilerlib_entity(imt_resolve_ident, imt_resolve_type);
 }
 
 
@@ -546,39 +729,22 @@ static ir_entity *find_method_in_hierachy(ir_entity *method, ir_type *klass)
 
 // Search klass for implementation of method and insert into itable
 static void add_method_to_itable(ir_type *klass, ir_type *interface,
-                                 ir_entity *method, ir_initializer_t *init,
+                                 ir_entity *method, ir_entity **impls,
                                  int offset)
 {
 	ir_entity *implementation = find_method_in_hierachy(method, klass);
 
-	ir_graph  *const_code = get_const_code_irg();
 	ir_entity *bound = oo_get_method_is_abstract(implementation)
 	                 ? ddispatch_model.abstract_method_entity
-	                 : implementation;
-	ir_node *symconst_node = new_r_Address(const_code, bound);
-	ir_initializer_t *val = create_initializer_const(symconst_node);
-	set_initializer_compound_value(init, offset, val);
+	                 : oo_get_method_implementation(implementation);
+	impls[offset] = bound;
 
 	add_itable_method_index(interface, method, offset);
 }
 
 static ir_entity* create_itable(ir_type *klass, ir_type *interface) {
 	size_t itable_size = count_interface_methods(interface);
-
-	// Create itable and initializer
-	ident *itable_ident = id_unique("itable_");
-	size_t itable_ent_size = itable_size;
-	ir_type *itable_type = new_type_array(type_reference, itable_ent_size);
-	set_type_state(itable_type, layout_fixed);
-
-	ir_type    *unknown      = get_unknown_type();
-	ir_type    *glob         = get_glob_type();
-	ir_entity  *itable       = new_entity(glob, itable_ident, unknown);
-
-	set_entity_type(itable, itable_type);
-	set_entity_alignment(itable, 32);
-
-	ir_initializer_t *init = create_initializer_compound(itable_ent_size);
+	ir_entity **impls  = XMALLOCN(ir_entity*, itable_size);
 
 	int n_method = 0;
 
@@ -588,7 +754,7 @@ static ir_entity* create_itable(ir_type *klass, ir_type *interface) {
 		if (oo_get_class_is_interface(klass_iterator->klass)) {
 			ddispatch_method_iterator_t *method_iterator = create_method_iterator(klass_iterator->klass);
 			while (method_iterator->exists) {
-				add_method_to_itable(klass, interface, method_iterator->method, init, n_method++);
+				add_method_to_itable(klass, interface, method_iterator->method, impls, n_method++);
 				method_iterator = method_iterator->next;
 			}
 			free_method_iterator(method_iterator);
@@ -600,12 +766,47 @@ static ir_entity* create_itable(ir_type *klass, ir_type *interface) {
 	// Iterator over interface and insert methods
 	ddispatch_method_iterator_t *method_iterator = create_method_iterator(interface);
 	while (method_iterator->exists) {
-		add_method_to_itable(klass, interface, method_iterator->method, init, n_method++);
+		add_method_to_itable(klass, interface, method_iterator->method, impls, n_method++);
 		method_iterator = method_iterator->next;
 	}
 	free_method_iterator(method_iterator);
+	assert((size_t)n_method == itable_size);
+
+	// Subclasses that do not override any of the interface's methods (and
+	// unrelated classes sharing implementations) get the same itable
+	ident **contents = XMALLOCN(ident*, itable_size);
+	for (size_t i = 0; i < itable_size; i++)
+		contents[i] = get_entity_ld_ident(impls[i]);
+
+	ir_entity *itable = table_pool_find(&itable_pool, contents, itable_size);
+	if (itable == NULL) {
+		// Create itable and initializer
+		ident *itable_ident = id_unique("itable_");
+		size_t itable_ent_size = itable_size;
+		ir_type *itable_type = new_type_array(type_reference, itable_ent_size);
+		set_type_state(itable_type, layout_fixed);
+
+		ir_type    *unknown      = get_unknown_type();
+		ir_type    *glob         = get_glob_type();
+		itable = new_entity(glob, itable_ident, unknown);
+
+		set_entity_type(itable, itable_type);
+		set_entity_alignment(itable, 32);
+
+		ir_graph         *const_code = get_const_code_irg();
+		ir_initializer_t *init       = create_initializer_compound(itable_ent_size);
+		for (size_t i = 0; i < itable_size; i++) {
+			ir_node *symconst_node = new_r_Address(const_code, impls[i]);
+			ir_initializer_t *val = create_initializer_const(symconst_node);
+			set_initializer_compound_value(init, i, val);
+		}
+		set_entity_initializer(itable, init);
+
+		table_pool_insert(&itable_pool, contents, itable_size, itable);
+	}
 
-	set_entity_initializer(itable, init);
+	free(contents);
+	free(impls);
 
 	return itable;
 }
@@ -631,15 +832,55 @@ static ir_initializer_t *create_itt(ir_type *klass, size_t size)
 	return initializer;
 }
 
-static void add_start_to_itt(ir_initializer_t *initializer)
+typedef struct {
+	ir_type  *interface;
+	uint32_t  key;
+} itt_slot;
+
+static int cmp_itt_slot(const void *p1, const void *p2)
+{
+	const itt_slot *s1 = (const itt_slot*)p1;
+	const itt_slot *s2 = (const itt_slot*)p2;
+	if (s1->key != s2->key)
+		return s1->key < s2->key ? -1 : 1;
+	// not get_type_nr, which is an address in release builds
+	return strcmp(get_compound_name(s1->interface), get_compound_name(s2->interface));
+}
+
+/* packed keys of a sorted ITT: number of entries, then one key per entry */
+static ir_entity *create_itt_keys(const itt_slot *slots, size_t n)
+{
+	ir_type *keys_type = new_type_array(type_uint, n + 1);
+	set_type_state(keys_type, layout_fixed);
+
+	ir_entity *keys = new_entity(get_glob_type(), id_unique("itt_keys_"), keys_type);
+	set_entity_visibility(keys, ir_visibility_private);
+
+	ir_graph         *const_code = get_const_code_irg();
+	ir_initializer_t *init       = create_initializer_compound(n + 1);
+	ir_node          *count      = new_r_Const_long(const_code, mode_Iu, n);
+	set_initializer_compound_value(init, 0, create_initializer_const(count));
+	for (size_t i = 0; i < n; i++) {
+		ir_node *key = new_r_Const_long(const_code, mode_Iu, slots[i].key);
+		set_initializer_compound_value(init, i + 1, create_initializer_const(key));
+	}
+	set_entity_initializer(keys, init);
+
+	return keys;
+}
+
+static void add_start_to_itt(ir_initializer_t *initializer, ir_entity *keys)
 {
 	ir_initializer_t *cinit;
 
 	if ((oo_get_interface_call_type() & call_searched_itable) == call_searched_itable) {
 		cinit = create_initializer_compound(4);
 
+		// index 0: packed keys of the entries
+		ir_node *keys_node = new_r_Address(get_const_code_irg(), keys);
 
-		// index 1/2: index of next/previous method (for move2front runtime mechanism)
+
+		// index 2/3: indices of the two most recently used entries (for move2front runtime mechanism)
 		ir_node *prev_node = new_r_Const_long(
 				get_const_code_irg(),
 				mode_int,
@@ -652,7 +893,7 @@ static void add_start_to_itt(ir_initializer_t *initializer)
 				1
 		);
 
-		set_initializer_compound_value(cinit, 0, get_initializer_null()); // it
+		set_initializer_compound_value(cinit, 0, create_initializer_const(keys_node)); // it
 		set_initializer_compound_value(cinit, 1, get_initializer_null()); // id
 		set_initializer_compound_value(cinit, 2, create_initializer_const(prev_node)); // prev
 		set_initializer_compound_value(cinit, 3, create_initializer_const(next_node)); // next
@@ -736,6 +977,170 @@ static bool is_interface_empty(ir_type *interface)
 	return true;
 }
 
+typedef struct {
+	struct obstack obst;
+	cpmap_t        ids;            /* interface -> dense id + 1 */
+	ir_type      **interfaces;
+	size_t         n_interfaces;
+	unsigned     **interferences;  /* per interface: bitset of conflicting ids */
+	unsigned      *colors;
+	size_t         n_slots_before;
+	size_t         n_slots_after;
+} coloring_env;
+
+typedef struct {
+	size_t id;
+	size_t degree;
+} coloring_node;
+
+static void collect_colorable_interface(ir_type *klass, void *data)
+{
+	coloring_env *env = (coloring_env*)data;
+	if (klass == get_glob_type() || !oo_get_class_is_interface(klass) || is_interface_empty(klass))
+		return;
+
+	cpmap_set(&env->ids, klass, INT_TO_PTR(++env->n_interfaces));
+	obstack_ptr_grow(&env->obst, klass);
+}
+
+/* dense ids of all non-empty interfaces implemented by klass, -1 terminated */
+static size_t *get_interface_ids(coloring_env *env, ir_type *klass)
+{
+	ddispatch_klass_iterator_t *iterator = create_klass_iterator(klass);
+	while (iterator->exists) {
+		void *id = cpmap_find(&env->ids, iterator->klass);
+		if (id != NULL) {
+			size_t dense_id = PTR_TO_INT(id) - 1;
+			obstack_grow(&env->obst, &dense_id, sizeof(dense_id));
+		}
+		iterator = iterator->next;
+	}
+	free_klass_iterator(iterator);
+
+	size_t end = (size_t)-1;
+	obstack_grow(&env->obst, &end, sizeof(end));
+	return obstack_finish(&env->obst);
+}
+
+static void add_interferences(ir_type *klass, void *data)
+{
+	coloring_env *env = (coloring_env*)data;
+	if (klass == get_glob_type() || oo_get_class_is_interface(klass)
+	    || oo_get_class_vtable_entity(klass) == NULL)
+		return;
+
+	size_t *ids = get_interface_ids(env, klass);
+	size_t  max = 0;
+	for (size_t *i = ids; *i != (size_t)-1; i++) {
+		for (size_t *j = i + 1; *j != (size_t)-1; j++) {
+			rbitset_set(env->interferences[*i], *j);
+			rbitset_set(env->interferences[*j], *i);
+		}
+		if (*i + 1 > max)
+			max = *i + 1;
+	}
+	env->n_slots_before += max;
+	obstack_free(&env->obst, ids);
+}
+
+static void count_colored_slots(ir_type *klass, void *data)
+{
+	coloring_env *env = (coloring_env*)data;
+	if (klass == get_glob_type() || oo_get_class_is_interface(klass)
+	    || oo_get_class_vtable_entity(klass) == NULL)
+		return;
+
+	size_t *ids = get_interface_ids(env, klass);
+	size_t  max = 0;
+	for (size_t *i = ids; *i != (size_t)-1; i++) {
+		if (env->colors[*i] + 1 > max)
+			max = env->colors[*i] + 1;
+	}
+	env->n_slots_after += max;
+	obstack_free(&env->obst, ids);
+}
+
+static int cmp_coloring_node(const void *p1, const void *p2)
+{
+	const coloring_node *n1 = (const coloring_node*)p1;
+	const coloring_node *n2 = (const coloring_node*)p2;
+	if (n1->degree != n2->degree)
+		return n1->degree < n2->degree ? 1 : -1;
+	return n1->id < n2->id ? -1 : n1->id > n2->id;
+}
+
+size_t ddispatch_color_interfaces(void)
+{
+	assert(get_interface_lookup_type() == call_itable_indexed);
+
+	coloring_env env;
+	memset(&env, 0, sizeof(env));
+	obstack_init(&env.obst);
+	cpmap_init(&env.ids, hash_ptr, ptr_equals);
+
+	class_walk_super2sub(collect_colorable_interface, NULL, &env);
+	size_t n = env.n_interfaces;
+	env.interfaces = obstack_finish(&env.obst);
+
+	// two interfaces interfere if a class implements both of them
+	env.interferences = XMALLOCN(unsigned*, n);
+	for (size_t i = 0; i < n; i++)
+		env.interferences[i] = rbitset_malloc(n);
+	class_walk_super2sub(add_interferences, NULL, &env);
+
+	// greedy coloring, highest degree first
+	coloring_node *order = XMALLOCN(coloring_node, n);
+	for (size_t i = 0; i < n; i++) {
+		order[i].id     = i;
+		order[i].degree = 0;
+		for (size_t j = 0; j < n; j++) {
+			if (rbitset_is_set(env.interferences[i], j))
+				order[i].degree++;
+		}
+	}
+	qsort(order, n, sizeof(*order), cmp_coloring_node);
+
+	env.colors          = XMALLOCN(unsigned, n);
+	unsigned *used      = rbitset_malloc(n);
+	unsigned  n_colors  = 0;
+	for (size_t i = 0; i < n; i++)
+		env.colors[i] = (unsigned)-1;
+	for (size_t o = 0; o < n; o++) {
+		size_t id = order[o].id;
+		rbitset_clear_all(used, n);
+		for (size_t j = 0; j < n; j++) {
+			if (env.colors[j] != (unsigned)-1 && rbitset_is_set(env.interferences[id], j))
+				rbitset_set(used, env.colors[j]);
+		}
+		unsigned color = 0;
+		while (rbitset_is_set(used, color))
+			color++;
+		env.colors[id] = color;
+		if (color + 1 > n_colors)
+			n_colors = color + 1;
+
+		cpmap_set(&interface_color_map, env.interfaces[id], INT_TO_PTR(color + 1));
+	}
+	// interfaces numbered later must not share an index with a colored one
+	if (interface_index < n_colors)
+		interface_index = n_colors;
+
+	class_walk_super2sub(count_colored_slots, NULL, &env);
+	size_t saved = (env.n_slots_before - env.n_slots_after)
+	             * get_type_size(ddispatch_get_itt_entry_type());
+
+	free(used);
+	free(env.colors);
+	free(order);
+	for (size_t i = 0; i < n; i++)
+		free(env.interferences[i]);
+	free(env.interferences);
+	cpmap_destroy(&env.ids);
+	obstack_free(&env.obst, NULL);
+
+	return saved;
+}
+
 void ddispatch_setup_itable(ir_type *klass)
 {
 	assert(is_Class_type(klass));
@@ -752,7 +1157,8 @@ void ddispatch_setup_itable(ir_type *klass)
 		}
 
 		interface_index_entry *entry = OALLOC(&ddispatch_obst, interface_index_entry);
-		entry->index = interface_index++;
+		void *color = cpmap_find(&interface_color_map, klass);
+		entry->index = color != NULL ? (unsigned)PTR_TO_INT(color) - 1 : interface_index++;
 		entry->interface = klass;
 
 		ir_initializer_t *init = get_initializer_null();
@@ -768,6 +1174,10 @@ void ddispatch_setup_itable(ir_type *klass)
 		return;
 	}
 
+	// the ITT is only reachable through the vtable
+	if (oo_get_class_vtable_entity(klass) == NULL)
+		return;
+
 	size_t n_itable_count = 0;
 	size_t itable_size = 0;
 	ddispatch_klass_iterator_t *iterator = create_klass_iterator(klass);
@@ -786,60 +1196,593 @@ void ddispatch_setup_itable(ir_type *klass)
 	}
 
 	if (n_itable_count > 0) {
-		size_t n_offset = 1;
+		bool searched = (oo_get_interface_call_type() & call_searched_itable) == call_searched_itable;
 
-		if ((oo_get_interface_call_type() & call_searched_itable) == call_searched_itable) {
-			itable_size = n_itable_count + 1;
+		if (searched) {
+			// header, one entry per interface and a NULL entry to mark the end
+			itable_size = n_itable_count + 2;
 		}
 
 		ir_initializer_t *initializer = create_itt(klass, itable_size);
 
-		if ((oo_get_interface_call_type() & call_searched_itable) == call_searched_itable) {
-			// NULL entry at end of ITT to mark end
-			add_start_to_itt(initializer);
-		}
-
 		// If setup_vtable has already been called (i.e., dispatch_setup_vtable has not been executed via typewalk
 		// but via finalize_class_type), ITT must be registered again (necessary for bytecode2firm)
 		ir_entity *vtable = oo_get_class_vtable_entity(klass);
-		if (vtable != NULL) {
-			ir_initializer_t *vtable_init = get_entity_initializer(vtable);
-			if (vtable_init != NULL) {
-				ir_entity *itt_entity = oo_get_class_itt_entity(klass);
-				ir_node *ref = new_r_Address(get_const_code_irg(), itt_entity);
-				set_initializer_compound_value(
-						vtable_init,
-						ddispatch_model.index_of_itt_ptr,
-						create_initializer_const(ref));
-			}
+		ir_initializer_t *vtable_init = get_entity_initializer(vtable);
+		if (vtable_init != NULL) {
+			ir_entity *itt_entity = oo_get_class_itt_entity(klass);
+			ir_node *ref = new_r_Address(get_const_code_irg(), itt_entity);
+			set_initializer_compound_value(
+					vtable_init,
+					ddispatch_model.index_of_itt_ptr,
+					create_initializer_const(ref));
 		}
 
-		// Recursively walks all parents of klass and generates for all interfaces I
-		// an itable (klass, I)
+		// Recursively walks all parents of klass and collects all interfaces I
+		itt_slot *slots   = XMALLOCN(itt_slot, n_itable_count);
+		size_t    n_slots = 0;
 		iterator = iterator->head;
 		while (iterator->exists) {
 			ir_type *st = iterator->klass;
 
-			if (oo_get_class_is_interface(st)) {
-				if (is_interface_empty(st) == false) {
-					size_t itt_index = n_offset++;
-					ir_entity *itable = create_itable(klass, st);
+			if (oo_get_class_is_interface(st) && !is_interface_empty(st)) {
+				slots[n_slots].interface = st;
+				slots[n_slots].key       = get_itt_key(st);
+				n_slots++;
+			}
+
+			iterator = iterator->next;
+		}
+		assert(n_slots == n_itable_count);
 
-					if (oo_get_interface_call_type() == call_itable_indexed) {
-						itt_index = ddispatch_get_itable_index(st);
-					}
+		if (searched) {
+			qsort(slots, n_slots, sizeof(*slots), cmp_itt_slot);
+			add_start_to_itt(initializer, create_itt_keys(slots, n_slots));
+		}
 
-					add_itable_to_itt(initializer, st, itable, itt_index, n_itable_count);
-				}
+		// generate an itable (klass, I) for every interface
+		for (size_t i = 0; i < n_slots; i++) {
+			ir_type   *st        = slots[i].interface;
+			size_t     itt_index = i + 1;
+			ir_entity *itable    = create_itable(klass, st);
+
+			if (get_interface_lookup_type() == call_itable_indexed) {
+				itt_index = ddispatch_get_itable_index(st);
 			}
 
-			iterator = iterator->next;
+			add_itable_to_itt(initializer, st, itable, itt_index, n_itable_count);
+		}
+		free(slots);
+	}
+
+	free_klass_iterator(iterator);
+}
+
+typedef struct {
+	ir_type    *klass;
+	size_t      n_entries;
+	size_t     *selectors;
+	ir_entity **impls;
+} dispatch_row;
+
+typedef struct {
+	struct obstack  obst;          /* rows and their selector columns */
+	struct obstack  impls;         /* implementations of the row being built */
+	struct obstack  rows;          /* dispatch_row* of all rows */
+	size_t          n_selectors;
+	size_t          n_rows;
+} row_displacement_env;
+
+/* rows and columns are only valid within this compilation unit */
+static void check_not_extern(ir_type *klass, void *data)
+{
+	(void)data;
+	if (klass != get_glob_type() && oo_get_class_is_extern(klass))
+		panic("call_row_displacement needs the complete class hierarchy, but %s is extern",
+		      get_compound_name(klass));
+}
+
+/* every interface method gets a column (selector + 1) in the dispatch table */
+static void number_selectors(ir_type *klass, void *data)
+{
+	row_displacement_env *env = (row_displacement_env*)data;
+	if (klass == get_glob_type() || !oo_get_class_is_interface(klass))
+		return;
+
+	ddispatch_method_iterator_t *iterator = create_method_iterator(klass);
+	while (iterator->exists) {
+		ir_entity *method = iterator->method;
+		if (cpmap_find(&selector_map, method) == NULL)
+			cpmap_set(&selector_map, method, INT_TO_PTR(++env->n_selectors));
+		iterator = iterator->next;
+	}
+	free_method_iterator(iterator);
+}
+
+static void add_row_entry(row_displacement_env *env, ir_type *klass, ir_entity *method)
+{
+	size_t  selector  = PTR_TO_INT(cpmap_find(&selector_map, method)) - 1;
+	size_t *selectors = (size_t*)obstack_base(&env->obst);
+	size_t  n         = obstack_object_size(&env->obst) / sizeof(size_t);
+	for (size_t i = 0; i < n; i++) {
+		if (selectors[i] == selector)
+			return;
+	}
+
+	ir_entity *implementation = find_method_in_hierachy(method, klass);
+	ir_entity *bound = implementation == NULL || oo_get_method_is_abstract(implementation)
+	                 ? ddispatch_model.abstract_method_entity
+	                 : implementation;
+	obstack_grow(&env->obst, &selector, sizeof(selector));
+	obstack_ptr_grow(&env->impls, bound);
+}
+
+static void collect_dispatch_row(ir_type *klass, void *data)
+{
+	row_displacement_env *env = (row_displacement_env*)data;
+	if (klass == get_glob_type() || oo_get_class_is_interface(klass)
+	    || oo_get_class_is_abstract(klass) || oo_get_class_vtable_entity(klass) == NULL)
+		return;
+
+	ddispatch_klass_iterator_t *iterator = create_klass_iterator(klass);
+	while (iterator->exists) {
+		ir_type *st = iterator->klass;
+		if (oo_get_class_is_interface(st)) {
+			ddispatch_method_iterator_t *method_iterator = create_method_iterator(st);
+			while (method_iterator->exists) {
+				add_row_entry(env, klass, method_iterator->method);
+				method_iterator = method_iterator->next;
+			}
+			free_method_iterator(method_iterator);
 		}
+		iterator = iterator->next;
+	}
+	free_klass_iterator(iterator);
+
+	size_t      n_entries = obstack_object_size(&env->impls) / sizeof(ir_entity*);
+	size_t     *selectors = obstack_finish(&env->obst);
+	ir_entity **impls     = obstack_finish(&env->impls);
+	if (n_entries == 0) {
+		obstack_free(&env->impls, impls);
+		obstack_free(&env->obst, selectors);
+		return;
+	}
+
+	dispatch_row *row = OALLOC(&env->obst, dispatch_row);
+	row->klass     = klass;
+	row->n_entries = n_entries;
+	row->selectors = selectors;
+	row->impls     = impls;
+	obstack_ptr_grow(&env->rows, row);
+	env->n_rows++;
+}
+
+static int cmp_dispatch_row(const void *p1, const void *p2)
+{
+	const dispatch_row *r1 = *(const dispatch_row**)p1;
+	const dispatch_row *r2 = *(const dispatch_row**)p2;
+	if (r1->n_entries != r2->n_entries)
+		return r1->n_entries < r2->n_entries ? 1 : -1;
+	// type numbers are addresses in release builds, names keep the table
+	// layout reproducible
+	ir_entity *vtable1 = oo_get_class_vtable_entity(r1->klass);
+	ir_entity *vtable2 = oo_get_class_vtable_entity(r2->klass);
+	return strcmp(get_entity_ld_name(vtable1), get_entity_ld_name(vtable2));
+}
+
+static ir_initializer_t *get_row_address_initializer(ir_type *klass)
+{
+	void     *base        = cpmap_find(&row_base_map, klass);
+	assert(base != NULL);
+	ir_type  *entry_type  = get_entity_owner(dispatch_entry_target);
+	ir_graph *const_code  = get_const_code_irg();
+	ir_mode  *mode_offset = get_reference_offset_mode(mode_reference);
+	long      offset      = (PTR_TO_INT(base) - 1) * get_type_size(entry_type);
+	ir_node  *table_addr  = new_r_Address(const_code, dispatch_table);
+	ir_node  *row_offset  = new_r_Const_long(const_code, mode_offset, offset);
+	ir_node  *row_addr    = new_r_Add(get_irg_start_block(const_code), table_addr, row_offset);
+	return create_initializer_const(row_addr);
+}
+
+void ddispatch_setup_dispatch_table(void)
+{
+	assert(get_interface_lookup_type() == call_row_displacement);
+	assert(dispatch_table == NULL);
+
+	row_displacement_env env;
+	memset(&env, 0, sizeof(env));
+	obstack_init(&env.obst);
+	obstack_init(&env.impls);
+	obstack_init(&env.rows);
+
+	class_walk_super2sub(check_not_extern, NULL, NULL);
+	class_walk_super2sub(number_selectors, NULL, &env);
+	class_walk_super2sub(collect_dispatch_row, NULL, &env);
+	size_t         n_rows = env.n_rows;
+	dispatch_row **rows   = obstack_finish(&env.rows);
+
+	// first fit, largest rows first: every row gets the smallest unused base
+	// at which all of its columns are still free. Everything below first_free
+	// is taken, so the search for a row starts where its first column can
+	// reach first_free.
+	qsort(rows, n_rows, sizeof(*rows), cmp_dispatch_row);
+
+	size_t      capacity   = env.n_selectors + 1;
+	size_t      size       = 0;
+	size_t      first_free = 0;
+	ir_entity **entries    = XMALLOCNZ(ir_entity*, capacity);
+	ir_type   **owners     = XMALLOCNZ(ir_type*, capacity);
+	bool       *base_used  = XMALLOCNZ(bool, capacity);
+	for (size_t r = 0; r < n_rows; r++) {
+		dispatch_row *row     = rows[r];
+		size_t        min_sel = row->selectors[0];
+		for (size_t i = 1; i < row->n_entries; i++) {
+			if (row->selectors[i] < min_sel)
+				min_sel = row->selectors[i];
+		}
+
+		size_t base = first_free > min_sel ? first_free - min_sel : 0;
+		for (;; base++) {
+			if (base + env.n_selectors > capacity) {
+				size_t new_capacity = 2 * capacity + env.n_selectors;
+				entries   = XREALLOC(entries, ir_entity*, new_capacity);
+				owners    = XREALLOC(owners, ir_type*, new_capacity);
+				base_used = XREALLOC(base_used, bool, new_capacity);
+				memset(entries + capacity, 0, (new_capacity - capacity) * sizeof(*entries));
+				memset(owners + capacity, 0, (new_capacity - capacity) * sizeof(*owners));
+				memset(base_used + capacity, 0, (new_capacity - capacity) * sizeof(*base_used));
+				capacity = new_capacity;
+			}
+
+			// the row address identifies the class in the class check
+			if (base_used[base])
+				continue;
+			bool fits = true;
+			for (size_t i = 0; i < row->n_entries && fits; i++) {
+				if (entries[base + row->selectors[i]] != NULL)
+					fits = false;
+			}
+			if (fits)
+				break;
+		}
+
+		base_used[base] = true;
+		for (size_t i = 0; i < row->n_entries; i++) {
+			size_t column = base + row->selectors[i];
+			entries[column] = row->impls[i];
+			owners[column]  = row->klass;
+			if (column + 1 > size)
+				size = column + 1;
+		}
+		while (first_free < capacity && entries[first_free] != NULL)
+			first_free++;
+		cpmap_set(&row_base_map, row->klass, INT_TO_PTR(base + 1));
+	}
+
+	// emit the table, every entry holds the row address of its class and the
+	// implementation, unused entries stay NULL
+	ir_type *entry_type = new_type_struct(new_id_from_str("dispatch_entry"));
+	dispatch_entry_owner  = new_entity(entry_type, new_id_from_str("owner"), type_reference);
+	dispatch_entry_target = new_entity(entry_type, new_id_from_str("target"), type_reference);
+	default_layout_compound_type(entry_type);
+
+	ir_type *table_type = new_type_array(entry_type, size);
+	set_type_state(table_type, layout_fixed);
+	dispatch_table = new_entity(get_glob_type(), id_unique("dispatch_table_"), table_type);
+	set_entity_visibility(dispatch_table, ir_visibility_private);
+	set_entity_alignment(dispatch_table, 32);
+
+	ir_initializer_t *init = create_initializer_compound(size);
+	for (size_t i = 0; i < size; i++) {
+		if (entries[i] == NULL) {
+			set_initializer_compound_value(init, i, get_initializer_null());
+			continue;
+		}
+		ir_graph         *const_code  = get_const_code_irg();
+		ir_node          *target      = new_r_Address(const_code, entries[i]);
+		ir_initializer_t *entry_init  = create_initializer_compound(2);
+		set_initializer_compound_value(entry_init, 0, get_row_address_initializer(owners[i]));
+		set_initializer_compound_value(entry_init, 1, create_initializer_const(target));
+		set_initializer_compound_value(init, i, entry_init);
+	}
+	set_entity_initializer(dispatch_table, init);
+
+	free(base_used);
+	free(owners);
+	free(entries);
+	obstack_free(&env.rows, NULL);
+	obstack_free(&env.impls, NULL);
+	obstack_free(&env.obst, NULL);
+}
+
+ir_initializer_t *ddispatch_get_dispatch_row_initializer(ir_type *klass)
+{
+	if (cpmap_find(&row_base_map, klass) == NULL)
+		return get_initializer_null();
+	return get_row_address_initializer(klass);
+}
+
+/* copies the itable pointers of klass' ITT in front of the address point */
+static void setup_embedded_itt(ir_type *klass, ir_initializer_t *vtable_init)
+{
+	ir_initializer_t *null_init = get_initializer_null();
+	unsigned          base      = ddispatch_model.vptr_points_to_index - n_embedded_itt_slots;
+	for (unsigned i = base; i < ddispatch_model.vptr_points_to_index; i++)
+		set_initializer_compound_value(vtable_init, i, null_init);
+
+	ir_entity *itt = oo_get_class_itt_entity(klass);
+	if (itt == NULL)
+		return;
+
+	/* interfaces with higher indices are looked up through the ITT pointer */
+	ir_initializer_t *itt_init = get_entity_initializer(itt);
+	size_t            n        = get_initializer_compound_n_entries(itt_init);
+	if (n > n_embedded_itt_slots)
+		n = n_embedded_itt_slots;
+	for (size_t i = 0; i < n; i++) {
+		ir_initializer_t *entry = get_initializer_compound_value(itt_init, i);
+		if (get_initializer_kind(entry) != IR_INITIALIZER_COMPOUND)
+			continue;
+
+		ir_initializer_t *itable = get_initializer_compound_value(entry, 0);
+		set_initializer_compound_value(vtable_init, ddispatch_model.vptr_points_to_index - 1 - i, itable);
+	}
+}
+
+int ddispatch_get_imt_slot(ir_entity *method)
+{
+	return string_hash(get_entity_ld_name(method)) & (DDISPATCH_IMT_SIZE - 1);
+}
+
+/* vtable index (relative to the vptr target) of the IMT conflict mask, the
+ * DDISPATCH_IMT_SIZE slots follow it */
+static unsigned get_imt_vtable_index(void)
+{
+	return ddispatch_model.index_of_first_method - ddispatch_model.vptr_points_to_index;
+}
+
+static ir_type *get_imt_conflict_type(void)
+{
+	if (imt_conflict_type == NULL) {
+		imt_conflict_type = new_type_struct(new_id_from_str("imt_conflict"));
+
+		new_entity(imt_conflict_type, new_id_from_str("name"), type_reference);
+		new_entity(imt_conflict_type, new_id_from_str("funcptr"), type_reference);
+		default_layout_compound_type(imt_conflict_type);
+	}
+
+	return imt_conflict_type;
+}
+
+static ir_initializer_t *create_imt_conflict_table(ir_entity **methods, ir_entity **impls, size_t n, int slot)
+{
+	ir_graph *const_code = get_const_code_irg();
+	ir_type  *entry_type = get_imt_conflict_type();
+
+	size_t n_conflicts = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (ddispatch_get_imt_slot(methods[i]) == slot)
+			n_conflicts++;
+	}
+
+	// NULL entry at the end marks the end of the table
+	ir_type *table_type = new_type_array(entry_type, n_conflicts + 1);
+	set_type_state(table_type, layout_fixed);
+	ir_entity *table = new_entity(get_glob_type(), id_unique("imt_conflicts_"), table_type);
+	set_entity_visibility(table, ir_visibility_private);
+	set_entity_alignment(table, 32);
+
+	ir_initializer_t *init = create_initializer_compound(n_conflicts + 1);
+	size_t            c    = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (ddispatch_get_imt_slot(methods[i]) != slot)
+			continue;
+
+		ir_entity        *name  = rtti_emit_string_const(get_entity_ld_name(methods[i]));
+		ir_initializer_t *entry = create_initializer_compound(2);
+		set_initializer_compound_value(entry, 0, create_initializer_const(new_r_Address(const_code, name)));
+		set_initializer_compound_value(entry, 1, create_initializer_const(new_r_Address(const_code, impls[i])));
+		set_initializer_compound_value(init, c++, entry);
 	}
+	set_initializer_compound_value(init, c, get_initializer_null());
+	set_entity_initializer(table, init);
 
+	return create_initializer_const(new_r_Address(const_code, table));
+}
+
+static void setup_imt(ir_type *klass, ir_initializer_t *vtable_init)
+{
+	// collect all interface methods of klass and their implementations
+	size_t n_methods = 0;
+	ddispatch_klass_iterator_t *iterator = create_klass_iterator(klass);
+	for (ddispatch_klass_iterator_t *it = iterator; it->exists; it = it->next) {
+		if (oo_get_class_is_interface(it->klass))
+			n_methods += count_interface_methods(it->klass);
+	}
+
+	ir_entity **methods = XMALLOCN(ir_entity*, n_methods);
+	ir_entity **impls   = XMALLOCN(ir_entity*, n_methods);
+	size_t      n       = 0;
+	for (ddispatch_klass_iterator_t *it = iterator; it->exists; it = it->next) {
+		if (!oo_get_class_is_interface(it->klass))
+			continue;
+
+		ddispatch_method_iterator_t *method_iterator = create_method_iterator(it->klass);
+		while (method_iterator->exists) {
+			ir_entity *method         = method_iterator->method;
+			ir_entity *implementation = find_method_in_hierachy(method, klass);
+			methods[n] = method;
+			impls[n]   = implementation == NULL || oo_get_method_is_abstract(implementation)
+			           ? ddispatch_model.abstract_method_entity
+			           : implementation;
+			n++;
+			method_iterator = method_iterator->next;
+		}
+		free_method_iterator(method_iterator);
+	}
 	free_klass_iterator(iterator);
+	assert(n <= n_methods);
+
+	ir_graph *const_code = get_const_code_irg();
+	unsigned  mask_index = get_imt_vtable_index() + ddispatch_model.vptr_points_to_index;
+	unsigned  imt_index  = mask_index + 1;
+	unsigned long mask   = 0;
+	for (int slot = 0; slot < DDISPATCH_IMT_SIZE; slot++) {
+		ir_entity *method    = NULL;
+		bool       conflict  = false;
+		for (size_t i = 0; i < n; i++) {
+			if (ddispatch_get_imt_slot(methods[i]) != slot)
+				continue;
+			if (method != NULL && impls[i] != method)
+				conflict = true;
+			method = impls[i];
+		}
+
+		ir_initializer_t *val;
+		if (conflict) {
+			val = create_imt_conflict_table(methods, impls, n, slot);
+			mask |= 1UL << slot;
+		} else if (method != NULL) {
+			val = create_initializer_const(new_r_Address(const_code, method));
+		} else {
+			val = get_initializer_null();
+		}
+		set_initializer_compound_value(vtable_init, imt_index + slot, val);
+	}
+
+	// the set bits of the mask mark the slots holding a conflict table
+	ir_mode *mode_offset = get_reference_offset_mode(mode_reference);
+	ir_node *mask_node   = new_r_Const_long(const_code, mode_offset, (long)mask);
+	set_initializer_compound_value(vtable_init, mask_index, create_initializer_const(mask_node));
+
+	free(methods);
+	free(impls);
+}
+
+/* the address vptrs point to, relative vtable slots are offsets to it */
+static ir_node *get_vtable_address_point(ir_entity *vtable)
+{
+	ir_graph *const_code  = get_const_code_irg();
+	ir_node  *block       = get_irg_start_block(const_code);
+	ir_mode  *mode_offset = get_reference_offset_mode(mode_reference);
+	ir_node  *vtable_addr = new_r_Address(const_code, vtable);
+	ir_node  *base        = new_r_Conv(block, vtable_addr, mode_offset);
+	if (ddispatch_model.vptr_points_to_index == 0)
+		return base;
+
+	long      offset      = ddispatch_model.vptr_points_to_index * get_type_size(type_reference);
+	ir_node  *offset_node = new_r_Const_long(const_code, mode_offset, offset);
+	return new_r_Add(block, base, offset_node);
+}
+
+/* methods of extern classes and runtime functions live in another module */
+static bool is_defined_locally(ir_entity *entity)
+{
+	if (!is_method_entity(entity))
+		return true;
+
+	ir_type *owner = get_entity_owner(entity);
+	if (is_Class_type(owner) && owner != get_glob_type())
+		return !oo_get_class_is_extern(owner);
+	return get_entity_irg(entity) != NULL;
+}
+
+/* a private function calling target, the offset to a symbol of another
+ * module would need a dynamic relocation again */
+static ir_entity *get_local_stub(ir_entity *target)
+{
+	ir_entity *stub = cpmap_find(&local_stub_map, target);
+	if (stub != NULL)
+		return stub;
+
+	ir_type *type = get_entity_type(target);
+	stub = new_entity(get_glob_type(), id_unique("relative_vtable_stub_"), type);
+	set_entity_visibility(stub, ir_visibility_private);
+	cpmap_set(&local_stub_map, target, stub);
+
+	ir_graph *irg      = new_ir_graph(stub, 0);
+	ir_node  *block    = get_r_cur_block(irg);
+	ir_node  *args     = get_irg_args(irg);
+	size_t    n_params = get_method_n_params(type);
+	ir_node **params   = XMALLOCN(ir_node*, n_params);
+	for (size_t i = 0; i < n_params; i++) {
+		ir_mode *mode = get_type_mode(get_method_param_type(type, i));
+		assert(mode != NULL && "compound parameters are not supported");
+		params[i] = new_r_Proj(args, mode, i);
+	}
+	ir_node  *callee   = new_r_Address(irg, target);
+	ir_node  *call     = new_r_Call(block, get_irg_initial_mem(irg), callee, n_params, params, type);
+	ir_node  *mem      = new_r_Proj(call, mode_M, pn_Call_M);
+	free(params);
+
+	size_t    n_ress   = get_method_n_ress(type);
+	ir_node  *ress     = new_r_Proj(call, mode_T, pn_Call_T_result);
+	ir_node **results  = XMALLOCN(ir_node*, n_ress);
+	for (size_t i = 0; i < n_ress; i++) {
+		ir_mode *mode = get_type_mode(get_method_res_type(type, i));
+		assert(mode != NULL && "compound results are not supported");
+		results[i] = new_r_Proj(ress, mode, i);
+	}
+	ir_node  *ret      = new_r_Return(block, mem, n_ress, results);
+	free(results);
+	add_immBlock_pred(get_irg_end_block(irg), ret);
+	irg_finalize_cons(irg);
+
+	return stub;
+}
+
+static ir_initializer_t *make_slot_relative(ir_entity *vtable, ir_initializer_t *slot)
+{
+	ir_graph *const_code  = get_const_code_irg();
+	ir_node  *value;
+	switch (get_initializer_kind(slot)) {
+	case IR_INITIALIZER_NULL:
+		// an offset of 0 would decode to the vtable itself
+		value = new_r_Address(const_code, ddispatch_model.abstract_method_entity);
+		break;
+	case IR_INITIALIZER_CONST:
+		value = get_initializer_const_value(slot);
+		break;
+	default:
+		return slot;
+	}
+	if (is_Address(value) && !is_defined_locally(get_Address_entity(value)))
+		value = new_r_Address(const_code, get_local_stub(get_Address_entity(value)));
+
+	ir_node  *block       = get_irg_start_block(const_code);
+	ir_mode  *mode_offset = get_reference_offset_mode(mode_reference);
+	ir_node  *target      = new_r_Conv(block, value, mode_offset);
+	ir_node  *offset      = new_r_Sub(block, target, get_vtable_address_point(vtable));
+	return create_initializer_const(offset);
 }
 
+/* inverse of make_slot_relative, for copying the slots of a superclass */
+static ir_initializer_t *make_slot_absolute(ir_initializer_t *slot)
+{
+	if (get_initializer_kind(slot) != IR_INITIALIZER_CONST)
+		return slot;
+
+	ir_node *value = get_initializer_const_value(slot);
+	if (!is_Sub(value))
+		return slot;
+	return create_initializer_const(get_Conv_op(get_Sub_left(value)));
+}
+
+/* loads vtable slot index (relative to the address point) as a pointer */
+static ir_node *load_vtable_slot(ir_node *block, ir_node *vtable_addr, int index, ir_type *type)
+{
+	ir_graph *irg           = get_irn_irg(block);
+	unsigned  type_ref_size = get_type_size(type_reference);
+	ir_mode  *mode_offset   = get_reference_offset_mode(mode_reference);
+	ir_node  *slot_offset   = new_r_Const_long(irg, mode_offset, index * (int)type_ref_size);
+	ir_node  *slot_addr     = new_r_Add(block, vtable_addr, slot_offset);
+
+	if (!oo_get_relative_vtables())
+		return new_immutable_load(block, slot_addr, mode_reference, type);
+
+	ir_node *offset = new_immutable_load(block, slot_addr, mode_offset, type);
+	return new_r_Add(block, vtable_addr, offset);
+}
 
 void ddispatch_setup_vtable(ir_type *klass)
 {
@@ -857,6 +1800,8 @@ void ddispatch_setup_vtable(ir_type *klass)
 		vtable_size = oo_get_class_vtable_size(superclass);
 	} else {
 		vtable_size = ddispatch_model.index_of_first_method-ddispatch_model.vptr_points_to_index;
+		if (get_interface_lookup_type() == call_imt)
+			vtable_size += DDISPATCH_IMT_SIZE + 1;
 	}
 
 	// assign vtable ids
@@ -904,6 +1849,8 @@ void ddispatch_setup_vtable(ir_type *klass)
 			          i < superclass_vtable_size+ddispatch_model.vptr_points_to_index;
 			          i++) {
 				ir_initializer_t *superclass_vtable_init_value = get_initializer_compound_value(superclass_vtable_init, i);
+				if (oo_get_relative_vtables() && i >= ddispatch_model.index_of_first_method)
+					superclass_vtable_init_value = make_slot_absolute(superclass_vtable_init_value);
 				set_initializer_compound_value (init, i, superclass_vtable_init_value);
 		}
 	}
@@ -926,9 +1873,93 @@ void ddispatch_setup_vtable(ir_type *klass)
 
 	(*ddispatch_model.init_vtable_slots)(klass, init, vtable_ent_size);
 
+	if (get_interface_lookup_type() == call_imt)
+		setup_imt(klass, init);
+	if (n_embedded_itt_slots > 0)
+		setup_embedded_itt(klass, init);
+
+	if (oo_get_relative_vtables()) {
+		for (size_t i = ddispatch_model.index_of_first_method; i < vtable_ent_size; i++) {
+			// the IMT conflict mask is no pointer
+			if (get_interface_lookup_type() == call_imt
+			    && i == get_imt_vtable_index() + ddispatch_model.vptr_points_to_index)
+				continue;
+			ir_initializer_t *slot = get_initializer_compound_value(init, i);
+			set_initializer_compound_value(init, i, make_slot_relative(vtable, slot));
+		}
+	}
+
 	set_entity_initializer(vtable, init);
 }
 
+static ddispatch_binding get_call_binding(ir_node *call, ir_entity *method)
+{
+	ir_type *classtype = get_entity_owner(method);
+
+	ddispatch_binding binding = oo_get_entity_binding(method);
+	if (binding == bind_unknown)
+		panic("method %s has no binding specified", get_entity_name(method));
+
+	/* If the call has been explicitly marked as statically bound, then obey. */
+	if (oo_get_call_is_statically_bound(call))
+		binding = bind_static;
+	if (binding == bind_dynamic && oo_get_method_is_final(method))
+		binding = bind_static;
+	if (binding == bind_dynamic && oo_get_class_is_final(classtype))
+		binding = bind_static;
+
+	return binding;
+}
+
+/* the guarded call duplicates the Call node, which is not done for calls
+ * with exception edges or compound results */
+static bool can_guard_call(ir_node *call)
+{
+	if (ir_throws_exception(call))
+		return false;
+
+	ir_type *type = get_Call_type(call);
+	for (size_t i = 0, n = get_method_n_ress(type); i < n; i++) {
+		if (get_type_mode(get_method_res_type(type, i)) == NULL)
+			return false;
+	}
+	return true;
+}
+
+static ir_entity *get_speculative_target(ir_node *call, ir_entity *method)
+{
+	if (ddispatch_model.speculative_target == NULL)
+		return NULL;
+	if (!ddispatch_can_split_call(call))
+		return NULL;
+
+	ir_entity *target = (*ddispatch_model.speculative_target)(call, method);
+	if (target == NULL || oo_get_method_is_abstract(target))
+		return NULL;
+	return target;
+}
+
+static void count_implementations(ir_entity *method, ir_entity **found, size_t *n_found)
+{
+	if (!oo_get_method_is_abstract(method) && !oo_get_method_is_inherited(method)
+	    && *found != method) {
+		*found = method;
+		(*n_found)++;
+	}
+
+	for (size_t i = 0, n = get_entity_n_overwrittenby(method); i < n; i++)
+		count_implementations(get_entity_overwrittenby(method, i), found, n_found);
+}
+
+ir_entity *ddispatch_speculate_single_implementation(ir_node *call, ir_entity *method)
+{
+	(void)call;
+	ir_entity *found   = NULL;
+	size_t     n_found = 0;
+	count_implementations(method, &found, &n_found);
+	return n_found == 1 ? found : NULL;
+}
+
 void ddispatch_lower_Call(ir_node* call)
 {
 	assert(is_Call(call));
@@ -948,20 +1979,12 @@ void ddispatch_lower_Call(ir_node* call)
 	ir_type *classtype = get_entity_owner(method);
 	assert(is_Class_type(classtype));
 
-	ddispatch_binding binding = oo_get_entity_binding(method);
-	if (binding == bind_unknown)
-		panic("method %s has no binding specified", get_entity_name(method));
-
-	/* If the call has been explicitly marked as statically bound, then obey. */
-	if (oo_get_call_is_statically_bound(call))
-		binding = bind_static;
-	if (binding == bind_dynamic && oo_get_method_is_final(method))
-		binding = bind_static;
-	if (binding == bind_dynamic && oo_get_class_is_final(classtype))
-		binding = bind_static;
+	ddispatch_binding binding = get_call_binding(call, method);
 
+	// the call may have been split already (see ddispatch_split_call), only
+	// the block of the MethodSel dominates all users of its results
 	ir_graph *irg   = get_irn_irg(call);
-	ir_node  *block = get_nodes_block(call);
+	ir_node  *block = get_nodes_block(methodsel);
 
 	ir_node *new_mem = mem;
 	ir_node *new_res;
@@ -971,27 +1994,34 @@ void ddispatch_lower_Call(ir_node* call)
 		break;
 
 	case bind_dynamic: {
+		ir_entity *target = get_speculative_target(call, method);
+		if (target != NULL) {
+			// needs control flow, see ddispatch_lower_deferred_calls
+			pdeq_putr(deferred_calls, call);
+			pdeq_putr(deferred_calls, target);
+			return;
+		}
+
 		ir_entity *vptr_entity  = oo_get_class_vptr_entity(classtype);
 		ir_type   *vptr_type    = get_entity_type(vptr_entity);
-		ir_node   *vptr         = new_r_Member(block, objptr, vptr_entity);
-
-		ir_node   *vtable_load  = new_r_Load(block, mem, vptr, mode_reference, vptr_type, cons_none);
-		ir_node   *vtable_addr  = new_r_Proj(vtable_load, mode_reference, pn_Load_res);
-		ir_node   *vtable_mem   = new_r_Proj(vtable_load, mode_M, pn_Load_M);
+		ir_node   *vtable_addr  = load_vtable_address(block, mem, objptr, classtype);
 
 		int        vtable_id    = oo_get_method_vtable_index(method);
 		assert(vtable_id != -1);
 
-		unsigned type_ref_size  = get_type_size(type_reference);
-		ir_mode *mode_offset    = get_reference_offset_mode(mode_reference);
-		ir_node *vtable_offset  = new_r_Const_long(irg, mode_offset, vtable_id * type_ref_size);
-		ir_node *funcptr_addr   = new_r_Add(block, vtable_addr, vtable_offset);
-		ir_node *callee_load    = new_r_Load(block, vtable_mem, funcptr_addr, mode_reference, vptr_type, cons_none);
-		new_res                 = new_r_Proj(callee_load, mode_reference, pn_Load_res);
-		new_mem                 = new_r_Proj(callee_load, mode_M, pn_Load_M);
+		new_res = load_vtable_slot(block, vtable_addr, vtable_id, vptr_type);
 		break;
 	}
 	case bind_interface:
+		if (get_interface_lookup_type() == call_imt
+		    || (oo_get_interface_call_type() & call_inline_cache) == call_inline_cache) {
+			// needs control flow, see ddispatch_lower_deferred_calls
+			if (block == get_irg_start_block(irg))
+				deferred_in_start_block = true;
+			pdeq_putr(deferred_calls, call);
+			pdeq_putr(deferred_calls, NULL);
+			return;
+		}
 		new_res = (*ddispatch_model.construct_interface_lookup)(objptr, classtype, method, irg, block, &new_mem);
 		break;
 
@@ -1006,6 +2036,470 @@ void ddispatch_lower_Call(ir_node* call)
 	turn_into_tuple(methodsel, ARRAY_SIZE(in), in);
 }
 
+/* number of entries of a monomorphic cache, i.e. how often it is filled */
+#define INLINE_CACHE_REFILLS 4
+
+static unsigned get_inline_cache_entries(void)
+{
+	unsigned size = oo_get_inline_cache_size();
+	return size > 1 ? size : INLINE_CACHE_REFILLS;
+}
+
+/*
+ * Layout of a call site cache, must match call_site_cache_t and
+ * inline_cache_t in the runtime.
+ */
+static ir_type *get_inline_cache_type(void)
+{
+	if (inline_cache_type == NULL) {
+		ir_type *pair_type = new_type_struct(new_id_from_str("inline_cache"));
+		inline_cache_vtable = new_entity(pair_type, new_id_from_str("vtable"), type_reference);
+		inline_cache_target = new_entity(pair_type, new_id_from_str("target"), type_reference);
+		default_layout_compound_type(pair_type);
+
+		ir_type *entries_type = new_type_array(pair_type, get_inline_cache_entries());
+		set_type_state(entries_type, layout_fixed);
+
+		inline_cache_type   = new_type_struct(new_id_from_str("call_site_cache"));
+		inline_cache_first  = new_entity(inline_cache_type, new_id_from_str("first"), new_type_pointer(pair_type));
+		inline_cache_n_used = new_entity(inline_cache_type, new_id_from_str("n_used"), type_int);
+		new_entity(inline_cache_type, new_id_from_str("size"), type_int);
+		new_entity(inline_cache_type, new_id_from_str("site"), type_reference);
+		new_entity(inline_cache_type, new_id_from_str("next_site"), type_reference);
+		inline_cache_hits   = new_entity(inline_cache_type, new_id_from_str("hits"), type_int);
+		new_entity(inline_cache_type, new_id_from_str("misses"), type_int);
+		new_entity(inline_cache_type, new_id_from_str("entries"), entries_type);
+		default_layout_compound_type(inline_cache_type);
+
+		// the pair checked by call sites that have not been filled yet
+		inline_cache_empty = new_entity(get_glob_type(), id_unique("inline_cache_empty_"), pair_type);
+		set_entity_visibility(inline_cache_empty, ir_visibility_private);
+		add_entity_linkage(inline_cache_empty, IR_LINKAGE_CONSTANT);
+		set_entity_initializer(inline_cache_empty, get_initializer_null());
+	}
+
+	return inline_cache_type;
+}
+
+static ir_initializer_t *create_inline_cache_initializer(ir_graph *irg, ir_entity *method)
+{
+	ir_type          *type    = get_inline_cache_type();
+	size_t            n       = get_compound_n_members(type);
+	ir_initializer_t *init    = create_initializer_compound(n);
+	ir_graph         *ccode   = get_const_code_irg();
+	for (size_t i = 0; i < n; i++)
+		set_initializer_compound_value(init, i, get_initializer_null());
+
+	// site name for the statistics: caller and called method
+	obstack_printf(&ddispatch_obst, "%s: %s.%s", get_entity_ld_name(get_irg_entity(irg)),
+	               get_compound_name(get_entity_owner(method)), get_entity_name(method));
+	obstack_1grow(&ddispatch_obst, '\0');
+	char      *site_name = obstack_finish(&ddispatch_obst);
+	ir_entity *site      = rtti_emit_string_const(site_name);
+	obstack_free(&ddispatch_obst, site_name);
+
+	ir_node *empty_node = new_r_Address(ccode, inline_cache_empty);
+	set_initializer_compound_value(init, 0, create_initializer_const(empty_node));
+	ir_node *size_node = new_r_Const_long(ccode, mode_int, get_inline_cache_entries());
+	set_initializer_compound_value(init, 2, create_initializer_const(size_node));
+	ir_node *site_node = new_r_Address(ccode, site);
+	set_initializer_compound_value(init, 3, create_initializer_const(site_node));
+
+	return init;
+}
+
+/*
+ * Returns the MethodSel the call's callee is projected from, or NULL if it
+ * has already been lowered: calls may share a MethodSel, which is turned into
+ * a Tuple by the first of them to be lowered.
+ */
+static ir_node *get_call_methodsel(ir_node *call)
+{
+	ir_node *callee = get_Call_ptr(call);
+	if (!is_Proj(callee))
+		return NULL;
+	ir_node *pred = get_Proj_pred(callee);
+	return is_MethodSel(pred) ? pred : NULL;
+}
+
+static void lower_inline_cache_call(ir_node *call)
+{
+	// a call sharing the MethodSel already lowered it, reuse its result
+	ir_node   *methodsel = get_call_methodsel(call);
+	if (methodsel == NULL)
+		return;
+
+	ir_node   *objptr    = get_MethodSel_ptr(methodsel);
+	ir_node   *mem       = get_MethodSel_mem(methodsel);
+	ir_entity *method    = get_MethodSel_entity(methodsel);
+	ir_type   *classtype = get_entity_owner(method);
+	ir_graph  *irg       = get_irn_irg(call);
+	bool       polymorphic = oo_get_inline_cache_size() > 1;
+
+	// everything the MethodSel depends on moves into a new block in front of
+	// the cache check, the old block becomes the join point
+	ir_node   *join_block = get_nodes_block(methodsel);
+	part_block(methodsel);
+	ir_node   *block      = get_nodes_block(methodsel);
+
+	// a writable cache cell for this call site, initially empty
+	ir_entity *cache      = new_entity(get_glob_type(), id_unique("inline_cache_"), get_inline_cache_type());
+	set_entity_visibility(cache, ir_visibility_private);
+	set_entity_initializer(cache, create_inline_cache_initializer(irg, method));
+	ir_node   *cache_addr = new_r_Address(irg, cache);
+
+	// load the receiver's vtable and the cached pair first points to. The
+	// runtime publishes first after writing the pair, the loads of the pair
+	// depend on its address and need no further ordering.
+	ir_node   *vtable_addr    = load_vtable_address(block, mem, objptr, classtype);
+
+	ir_node   *first_addr     = new_r_Member(block, cache_addr, inline_cache_first);
+	ir_node   *first_load     = new_r_Load(block, mem, first_addr, mode_reference, type_reference, cons_none);
+	ir_node   *first          = new_r_Proj(first_load, mode_reference, pn_Load_res);
+	ir_node   *cur_mem        = new_r_Proj(first_load, mode_M, pn_Load_M);
+
+	ir_node   *cached_vt_addr = new_r_Member(block, first, inline_cache_vtable);
+	ir_node   *cached_vtable  = new_immutable_load(block, cached_vt_addr, mode_reference, type_reference);
+	ir_node   *cached_t_addr  = new_r_Member(block, first, inline_cache_target);
+	ir_node   *cached_target  = new_immutable_load(block, cached_t_addr, mode_reference, type_reference);
+
+	ir_node   *cmp            = new_r_Cmp(block, vtable_addr, cached_vtable, ir_relation_equal);
+	ir_node   *cond           = new_r_Cond(block, cmp);
+	ir_node   *proj_hit       = new_r_Proj(cond, mode_X, pn_Cond_true);
+	ir_node   *proj_miss      = new_r_Proj(cond, mode_X, pn_Cond_false);
+
+	ir_node   *join_preds[4];
+	ir_node   *mem_ins[4];
+	ir_node   *res_ins[4];
+	int        n_preds        = 0;
+
+	ir_node   *hit_mem        = cur_mem;
+	if (oo_get_inline_cache_stats()) {
+		// count the hit, racy but good enough for statistics
+		ir_node *hit_block = new_r_Block(irg, 1, &proj_hit);
+		ir_node *hits_addr = new_r_Member(hit_block, cache_addr, inline_cache_hits);
+		ir_node *hits_load = new_r_Load(hit_block, hit_mem, hits_addr, mode_int, type_int, cons_none);
+		ir_node *hits      = new_r_Proj(hits_load, mode_int, pn_Load_res);
+		         hit_mem   = new_r_Proj(hits_load, mode_M, pn_Load_M);
+		ir_node *one       = new_r_Const_long(irg, mode_int, 1);
+		ir_node *new_hits  = new_r_Add(hit_block, hits, one);
+		ir_node *store     = new_r_Store(hit_block, hit_mem, hits_addr, new_hits, type_int, cons_none);
+		         hit_mem   = new_r_Proj(store, mode_M, pn_Store_M);
+		proj_hit = new_r_Jmp(hit_block);
+	}
+	join_preds[n_preds] = proj_hit;
+	mem_ins[n_preds]    = hit_mem;
+	res_ins[n_preds]    = cached_target;
+	n_preds++;
+
+	// a megamorphic call site directly uses the configured lookup
+	ir_node   *miss_block     = new_r_Block(irg, 1, &proj_miss);
+	ir_node   *miss_mem       = cur_mem;
+	ir_node   *n_used_addr    = new_r_Member(miss_block, cache_addr, inline_cache_n_used);
+	ir_node   *n_used_load    = new_r_Load(miss_block, miss_mem, n_used_addr, mode_int, type_int, cons_none);
+	ir_node   *n_used         = new_r_Proj(n_used_load, mode_int, pn_Load_res);
+	           miss_mem       = new_r_Proj(n_used_load, mode_M, pn_Load_M);
+	ir_node   *size           = new_r_Const_long(irg, mode_int, get_inline_cache_entries());
+	ir_node   *mega_cmp       = new_r_Cmp(miss_block, n_used, size, ir_relation_greater);
+	ir_node   *mega_cond      = new_r_Cond(miss_block, mega_cmp);
+	ir_node   *proj_mega      = new_r_Proj(mega_cond, mode_X, pn_Cond_true);
+	ir_node   *proj_fill      = new_r_Proj(mega_cond, mode_X, pn_Cond_false);
+
+	ir_node   *mega_block     = new_r_Block(irg, 1, &proj_mega);
+	ir_node   *mega_mem       = miss_mem;
+	ir_node   *mega_target    = (*ddispatch_model.construct_interface_lookup)(objptr, classtype, method, irg, mega_block, &mega_mem);
+	join_preds[n_preds] = new_r_Jmp(mega_block);
+	mem_ins[n_preds]    = mega_mem;
+	res_ins[n_preds]    = mega_target;
+	n_preds++;
+
+	ir_node   *fill_block     = new_r_Block(irg, 1, &proj_fill);
+	if (polymorphic) {
+		// search the other cached pairs, NULL if there is none
+		ir_node *callee       = new_r_Address(irg, polymorphic_cache_lookup_entity);
+		ir_node *args[2]      = { cache_addr, vtable_addr };
+		ir_type *call_type    = get_entity_type(polymorphic_cache_lookup_entity);
+		ir_node *lookup       = new_r_Call(fill_block, miss_mem, callee, 2, args, call_type);
+		         miss_mem     = new_r_Proj(lookup, mode_M, pn_Call_M);
+		ir_node *ress         = new_r_Proj(lookup, mode_T, pn_Call_T_result);
+		ir_node *found        = new_r_Proj(ress, mode_reference, 0);
+
+		ir_node *null         = new_r_Const_long(irg, mode_reference, 0);
+		ir_node *found_cmp    = new_r_Cmp(fill_block, found, null, ir_relation_less_greater);
+		ir_node *found_cond   = new_r_Cond(fill_block, found_cmp);
+		ir_node *proj_found   = new_r_Proj(found_cond, mode_X, pn_Cond_true);
+		ir_node *proj_lookup  = new_r_Proj(found_cond, mode_X, pn_Cond_false);
+
+		join_preds[n_preds] = proj_found;
+		mem_ins[n_preds]    = miss_mem;
+		res_ins[n_preds]    = found;
+		n_preds++;
+
+		fill_block = new_r_Block(irg, 1, &proj_lookup);
+	}
+
+	// use the configured lookup and add the result to the cache
+	ir_entity *update_entity  = polymorphic ? polymorphic_cache_update_entity
+	                                        : inline_cache_update_entity;
+	ir_node   *miss_target    = (*ddispatch_model.construct_interface_lookup)(objptr, classtype, method, irg, fill_block, &miss_mem);
+	ir_node   *callee         = new_r_Address(irg, update_entity);
+	ir_node   *args[3]        = { cache_addr, vtable_addr, miss_target };
+	ir_type   *call_type      = get_entity_type(update_entity);
+	ir_node   *update         = new_r_Call(fill_block, miss_mem, callee, 3, args, call_type);
+	           miss_mem       = new_r_Proj(update, mode_M, pn_Call_M);
+
+	join_preds[n_preds] = new_r_Jmp(fill_block);
+	mem_ins[n_preds]    = miss_mem;
+	res_ins[n_preds]    = miss_target;
+	n_preds++;
+
+	set_irn_in(join_block, n_preds, join_preds);
+
+	ir_node   *phi_mem        = new_r_Phi(join_block, n_preds, mem_ins, mode_M);
+	add_Block_phi(join_block, phi_mem);
+	ir_node   *phi_res        = new_r_Phi(join_block, n_preds, res_ins, mode_reference);
+	add_Block_phi(join_block, phi_res);
+
+	set_nodes_block(methodsel, join_block);
+	ir_node *in[] = {
+		[pn_MethodSel_M]   = phi_mem,
+		[pn_MethodSel_res] = phi_res,
+	};
+	turn_into_tuple(methodsel, ARRAY_SIZE(in), in);
+}
+
+static void lower_imt_call(ir_node *call)
+{
+	// a call sharing the MethodSel already lowered it, reuse its result
+	ir_node   *methodsel = get_call_methodsel(call);
+	if (methodsel == NULL)
+		return;
+
+	ir_node   *objptr    = get_MethodSel_ptr(methodsel);
+	ir_node   *mem       = get_MethodSel_mem(methodsel);
+	ir_entity *method    = get_MethodSel_entity(methodsel);
+	ir_type   *classtype = get_entity_owner(method);
+	ir_graph  *irg       = get_irn_irg(call);
+
+	ir_node   *join_block = get_nodes_block(methodsel);
+	part_block(methodsel);
+	ir_node   *block      = get_nodes_block(methodsel);
+
+	// load the IMT slot, just like a vtable entry
+	ir_entity *vptr_entity   = oo_get_class_vptr_entity(classtype);
+	ir_type   *vptr_type     = get_entity_type(vptr_entity);
+	ir_node   *vtable_addr   = load_vtable_address(block, mem, objptr, classtype);
+	ir_node   *hit_mem       = mem;
+
+	int        imt_slot      = ddispatch_get_imt_slot(method);
+	unsigned   slot          = get_imt_vtable_index() + 1 + imt_slot;
+	ir_mode   *mode_offset   = get_reference_offset_mode(mode_reference);
+	ir_node   *slot_value    = load_vtable_slot(block, vtable_addr, slot, vptr_type);
+
+	// the conflict mask of the class tells whether the slot holds a conflict table
+	unsigned   type_ref_size = get_type_size(type_reference);
+	ir_node   *mask_offset   = new_r_Const_long(irg, mode_offset, get_imt_vtable_index() * type_ref_size);
+	ir_node   *mask_addr     = new_r_Add(block, vtable_addr, mask_offset);
+	ir_node   *mask          = new_immutable_load(block, mask_addr, mode_offset, vptr_type);
+	ir_node   *bit           = new_r_Const_long(irg, mode_offset, (long)(1UL << imt_slot));
+	ir_node   *tag           = new_r_And(block, mask, bit);
+	ir_node   *zero          = new_r_Const_long(irg, mode_offset, 0);
+	ir_node   *cmp           = new_r_Cmp(block, tag, zero, ir_relation_equal);
+	ir_node   *cond          = new_r_Cond(block, cmp);
+	ir_node   *proj_direct   = new_r_Proj(cond, mode_X, pn_Cond_true);
+	ir_node   *proj_conflict = new_r_Proj(cond, mode_X, pn_Cond_false);
+
+	ir_node   *conflict_block = new_r_Block(irg, 1, &proj_conflict);
+	ir_entity *name_const    = rtti_emit_string_const(get_entity_ld_name(method));
+	ir_node   *name_ref      = new_r_Address(irg, name_const);
+	ir_node   *callee        = new_r_Address(irg, imt_resolve_entity);
+	ir_node   *args[2]       = { slot_value, name_ref };
+	ir_type   *call_type     = get_entity_type(imt_resolve_entity);
+	ir_node   *resolve       = new_r_Call(conflict_block, hit_mem, callee, 2, args, call_type);
+	ir_node   *conflict_mem  = new_r_Proj(resolve, mode_M, pn_Call_M);
+	ir_node   *ress          = new_r_Proj(resolve, mode_T, pn_Call_T_result);
+	ir_node   *resolved      = new_r_Proj(ress, mode_reference, 0);
+	ir_node   *conflict_jmp  = new_r_Jmp(conflict_block);
+
+	ir_node   *join_preds[2] = { proj_direct, conflict_jmp };
+	set_irn_in(join_block, ARRAY_SIZE(join_preds), join_preds);
+
+	ir_node   *mem_ins[2]    = { hit_mem, conflict_mem };
+	ir_node   *phi_mem       = new_r_Phi(join_block, ARRAY_SIZE(mem_ins), mem_ins, mode_M);
+	add_Block_phi(join_block, phi_mem);
+	ir_node   *res_ins[2]    = { slot_value, resolved };
+	ir_node   *phi_res       = new_r_Phi(join_block, ARRAY_SIZE(res_ins), res_ins, mode_reference);
+	add_Block_phi(join_block, phi_res);
+
+	set_nodes_block(methodsel, join_block);
+	ir_node *in[] = {
+		[pn_MethodSel_M]   = phi_mem,
+		[pn_MethodSel_res] = phi_res,
+	};
+	turn_into_tuple(methodsel, ARRAY_SIZE(in), in);
+}
+
+bool ddispatch_can_split_call(ir_node *call)
+{
+	ir_graph *irg = get_irn_irg(call);
+	return get_nodes_block(call) != get_irg_start_block(irg) && can_guard_call(call);
+}
+
+void ddispatch_split_call(ir_node *call, size_t n_targets, ir_entity *const *targets)
+{
+	assert(n_targets > 0);
+	assert(ddispatch_can_split_call(call));
+
+	ir_graph  *irg        = get_irn_irg(call);
+	ir_node   *callee     = get_Call_ptr(call);
+	ir_node   *join_block = get_nodes_block(call);
+	part_block(call);
+	ir_node   *block      = get_nodes_block(call);
+
+	ir_type   *call_type  = get_Call_type(call);
+	ir_node   *call_mem   = get_Call_mem(call);
+	int        n_params   = get_Call_n_params(call);
+	ir_node  **params     = XMALLOCN(ir_node*, n_params);
+	for (int i = 0; i < n_params; i++)
+		params[i] = get_Call_param(call, i);
+
+	// one direct call per target plus the indirect fallback
+	size_t     n_calls    = n_targets + 1;
+	ir_node  **calls      = XMALLOCN(ir_node*, n_calls);
+	ir_node  **jmps       = XMALLOCN(ir_node*, n_calls);
+	for (size_t i = 0; i < n_targets; i++) {
+		ir_node *target_addr = new_r_Address(irg, targets[i]);
+		ir_node *cmp         = new_r_Cmp(block, callee, target_addr, ir_relation_equal);
+		ir_node *cond        = new_r_Cond(block, cmp);
+		ir_node *proj_direct = new_r_Proj(cond, mode_X, pn_Cond_true);
+		ir_node *proj_next   = new_r_Proj(cond, mode_X, pn_Cond_false);
+
+		ir_node *direct_block = new_r_Block(irg, 1, &proj_direct);
+		calls[i] = new_r_Call(direct_block, call_mem, target_addr, n_params, params, call_type);
+		jmps[i]  = new_r_Jmp(direct_block);
+
+		block = new_r_Block(irg, 1, &proj_next);
+	}
+	calls[n_targets] = new_r_Call(block, call_mem, callee, n_params, params, call_type);
+	jmps[n_targets]  = new_r_Jmp(block);
+	free(params);
+
+	set_irn_in(join_block, n_calls, jmps);
+
+	ir_node  **ins        = XMALLOCN(ir_node*, n_calls);
+	for (size_t c = 0; c < n_calls; c++)
+		ins[c] = new_r_Proj(calls[c], mode_M, pn_Call_M);
+	ir_node   *phi_mem    = new_r_Phi(join_block, n_calls, ins, mode_M);
+	add_Block_phi(join_block, phi_mem);
+
+	size_t     n_ress     = get_method_n_ress(call_type);
+	ir_node  **res_phis   = XMALLOCN(ir_node*, n_ress);
+	for (size_t i = 0; i < n_ress; i++) {
+		ir_mode *mode = get_type_mode(get_method_res_type(call_type, i));
+		for (size_t c = 0; c < n_calls; c++) {
+			ir_node *ress = new_r_Proj(calls[c], mode_T, pn_Call_T_result);
+			ins[c] = new_r_Proj(ress, mode, i);
+		}
+		res_phis[i] = new_r_Phi(join_block, n_calls, ins, mode);
+		add_Block_phi(join_block, res_phis[i]);
+	}
+	free(ins);
+	free(jmps);
+	free(calls);
+
+	set_nodes_block(call, join_block);
+	ir_node *bad_x = new_r_Bad(irg, mode_X);
+	ir_node *in[] = {
+		[pn_Call_M]         = phi_mem,
+		[pn_Call_T_result]  = new_r_Tuple(join_block, n_ress, res_phis),
+		[pn_Call_X_regular] = bad_x,
+		[pn_Call_X_except]  = bad_x,
+	};
+	turn_into_tuple(call, ARRAY_SIZE(in), in);
+	free(res_phis);
+}
+
+static void lower_guarded_call(ir_node *call, ir_entity *target)
+{
+	// a sibling call sharing the MethodSel may have lowered it already (to
+	// the vtable slot), the guard then compares that value with the target
+	ir_node   *methodsel = get_call_methodsel(call);
+	if (methodsel != NULL) {
+		ir_node   *objptr    = get_MethodSel_ptr(methodsel);
+		ir_node   *mem       = get_MethodSel_mem(methodsel);
+		ir_entity *method    = get_MethodSel_entity(methodsel);
+		ir_type   *classtype = get_entity_owner(method);
+		ir_node   *block     = get_nodes_block(methodsel);
+
+		// load the vtable slot, ddispatch_split_call compares it with the target
+		ir_entity *vptr_entity = oo_get_class_vptr_entity(classtype);
+		ir_type   *vptr_type   = get_entity_type(vptr_entity);
+		ir_node   *vtable_addr = load_vtable_address(block, mem, objptr, classtype);
+		int        vtable_id   = oo_get_method_vtable_index(method);
+		assert(vtable_id != -1);
+		ir_node   *slot_value  = load_vtable_slot(block, vtable_addr, vtable_id, vptr_type);
+
+		ir_node *sel_in[] = {
+			[pn_MethodSel_M]   = mem,
+			[pn_MethodSel_res] = slot_value,
+		};
+		turn_into_tuple(methodsel, ARRAY_SIZE(sel_in), sel_in);
+	}
+
+	ddispatch_split_call(call, 1, &target);
+}
+
+static void collect_start_block_node(ir_node *node, void *env)
+{
+	if (is_Block(node) || is_Proj(node) || is_irn_start_block_placed(node))
+		return;
+	if (get_nodes_block(node) == get_irg_start_block(get_irn_irg(node)))
+		pdeq_putr((pdeq*)env, node);
+}
+
+/* moves everything that doesn't have to stay in the start block into a new
+ * block behind it, so part_block can split it like any other block */
+static void move_out_of_start_block(ir_graph *irg)
+{
+	pdeq *nodes = new_pdeq();
+	irg_walk_graph(irg, NULL, collect_start_block_node, nodes);
+
+	ir_node *jmp   = new_r_Jmp(get_irg_start_block(irg));
+	ir_node *block = new_r_Block(irg, 1, &jmp);
+	while (!pdeq_empty(nodes))
+		set_nodes_block(pdeq_getl(nodes), block);
+	del_pdeq(nodes);
+}
+
+void ddispatch_lower_deferred_calls(ir_graph *irg)
+{
+	if (pdeq_empty(deferred_calls))
+		return;
+
+	if (deferred_in_start_block) {
+		move_out_of_start_block(irg);
+		deferred_in_start_block = false;
+	}
+
+	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK | IR_RESOURCE_PHI_LIST);
+	collect_phiprojs_and_start_block_nodes(irg);
+
+	while (!pdeq_empty(deferred_calls)) {
+		ir_node   *call   = pdeq_getl(deferred_calls);
+		ir_entity *target = pdeq_getl(deferred_calls);
+		assert(get_irn_irg(call) == irg);
+		if (target != NULL)
+			lower_guarded_call(call, target);
+		else if (get_interface_lookup_type() == call_imt)
+			lower_imt_call(call);
+		else
+			lower_inline_cache_call(call);
+	}
+
+	ir_free_resources(irg, IR_RESOURCE_IRN_LINK | IR_RESOURCE_PHI_LIST);
+	confirm_irg_properties(irg, IR_GRAPH_PROPERTIES_NONE);
+}
+
 void ddispatch_prepare_new_instance(dbg_info *dbgi, ir_node *block, ir_node *objptr, ir_node **mem, ir_type* klass)
 {
 	ir_graph *irg = get_irn_irg(block);
@@ -1039,10 +2533,16 @@ void ddispatch_set_vtable_layout(unsigned vptr_points_to_index, unsigned index_o
 	assert (index_of_first_method >= vptr_points_to_index);
 	assert (func);
 
+	/* keep the embedded itable slots in front of the new layout */
+	unsigned n_slots = n_embedded_itt_slots;
+	ddispatch_model.index_of_itt_ptr -= n_slots;
+	n_embedded_itt_slots = 0;
+
 	ddispatch_model.vptr_points_to_index  = vptr_points_to_index;
 	ddispatch_model.index_of_first_method = index_of_first_method;
 	ddispatch_model.index_of_rtti_ptr     = index_of_rtti_ptr;
 	ddispatch_model.init_vtable_slots     = func;
+	embed_itt_slots(n_slots);
 }
 
 void ddispatch_set_interface_lookup_constructor(construct_interface_lookup_t func)
@@ -1051,6 +2551,11 @@ void ddispatch_set_interface_lookup_constructor(construct_interface_lookup_t fun
 	ddispatch_model.construct_interface_lookup = func;
 }
 
+void ddispatch_set_speculative_target_callback(speculative_target_t func)
+{
+	ddispatch_model.speculative_target = func;
+}
+
 void ddispatch_set_abstract_method_entity(ir_entity *entity)
 {
 	assert(entity != NULL);
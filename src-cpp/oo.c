@@ -1,15 +1,21 @@
 #include "liboo/oo.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include "liboo/rtti.h"
 #include "liboo/dmemory.h"
 #include "liboo/nodes.h"
 #include "liboo/eh.h"
+#include "liboo/opt.h"
 #include "adt/obst.h"
 #include "libfirm/adt/pmap.h"
 #include "adt/error.h"
 #include "gen_irnode.h"
 
+// stats
+#define OO_STATS 1
+#undef OO_STATS // comment to activate stats
+
 typedef enum {
 	oo_is_abstract  = 1 << 0,
 	oo_is_final     = 1 << 1,
@@ -29,6 +35,9 @@ typedef enum {
 typedef struct {
 	oo_info_kind  kind;
 	unsigned      uid;
+	unsigned      preorder_uid;
+	unsigned      max_subclass_uid;
+	unsigned      preorder_numbering;
 	ir_entity    *vptr;
 	ir_entity    *rtti;
 	ir_entity    *itt;
@@ -56,6 +65,15 @@ static struct obstack  oo_info_obst;
 static pmap           *oo_node_info_map = NULL;
 
 static ddispatch_interface_call interface_call_type;
+static unsigned inline_cache_size = 1;
+static bool inline_cache_stats;
+static bool interface_coloring;
+static bool relative_vtables;
+static unsigned embedded_itts;
+static bool closed_world;
+static bool                     preorder_class_uids;
+static unsigned                 next_preorder_uid;
+static unsigned                 preorder_numbering;
 
 static oo_type_info *get_type_info(ir_type *type)
 {
@@ -115,6 +133,48 @@ void oo_set_class_uid(ir_type *classtype, unsigned uid)
 	ti->uid = uid;
 }
 
+unsigned oo_get_class_preorder_uid(ir_type *classtype)
+{
+	assert(is_Class_type(classtype));
+	oo_type_info *ti = get_type_info(classtype);
+	return ti->preorder_uid;
+}
+
+void oo_set_class_preorder_uid(ir_type *classtype, unsigned uid)
+{
+	assert(is_Class_type(classtype));
+	oo_type_info *ti = get_type_info(classtype);
+	ti->preorder_uid = uid;
+}
+
+unsigned oo_get_class_max_subclass_uid(ir_type *classtype)
+{
+	assert(is_Class_type(classtype));
+	oo_type_info *ti = get_type_info(classtype);
+	return ti->max_subclass_uid;
+}
+
+void oo_set_class_max_subclass_uid(ir_type *classtype, unsigned uid)
+{
+	assert(is_Class_type(classtype));
+	oo_type_info *ti = get_type_info(classtype);
+	ti->max_subclass_uid = uid;
+}
+
+unsigned oo_get_class_preorder_numbering(ir_type *classtype)
+{
+	assert(is_Class_type(classtype));
+	oo_type_info *ti = get_type_info(classtype);
+	return ti->preorder_numbering;
+}
+
+void oo_set_class_preorder_numbering(ir_type *classtype, unsigned numbering)
+{
+	assert(is_Class_type(classtype));
+	oo_type_info *ti = get_type_info(classtype);
+	ti->preorder_numbering = numbering;
+}
+
 ir_entity *oo_get_class_vtable_entity(ir_type *classtype)
 {
 	assert(is_Class_type(classtype));
@@ -459,6 +519,17 @@ ir_entity *oo_get_entity_overwritten_superclass_entity(ir_entity *entity)
 	return superclass_entity;
 }
 
+ir_entity *oo_get_method_implementation(ir_entity *method)
+{
+	while (oo_get_method_is_inherited(method)) {
+		ir_entity *super = oo_get_entity_overwritten_superclass_entity(method);
+		if (super == NULL)
+			break;
+		method = super;
+	}
+	return method;
+}
+
 void oo_copy_entity_info(ir_entity *src, ir_entity *dest)
 {
 	oo_entity_info *ei_src  = get_entity_info(src);
@@ -485,6 +556,43 @@ static void construct_runtime_typeinfo_proxy(ir_type *klass, void *env)
 	rtti_construct_runtime_typeinfo(klass);
 }
 
+static void assign_preorder_uids_rec(ir_type *klass)
+{
+	oo_set_class_preorder_uid(klass, next_preorder_uid++);
+
+	size_t n_subtypes = get_class_n_subtypes(klass);
+	for (size_t s = 0; s < n_subtypes; s++) {
+		ir_type *st = get_class_subtype(klass, s);
+		if (oo_get_class_is_interface(st))
+			continue;
+		assign_preorder_uids_rec(st);
+	}
+
+	oo_set_class_max_subclass_uid(klass, next_preorder_uid-1);
+	oo_set_class_preorder_numbering(klass, preorder_numbering);
+}
+
+static void assign_preorder_uid_proxy(ir_type *klass, void *env)
+{
+	(void)env;
+	if (klass == get_glob_type())
+		return;
+
+	if (oo_get_class_is_interface(klass)) {
+		/* interfaces are not part of the class tree, give them an interval
+		 * containing just themselves */
+		unsigned uid = next_preorder_uid++;
+		oo_set_class_preorder_uid(klass, uid);
+		oo_set_class_max_subclass_uid(klass, uid);
+		oo_set_class_preorder_numbering(klass, preorder_numbering);
+		return;
+	}
+
+	/* number each tree of classes at its root */
+	if (oo_get_class_superclass(klass) == NULL)
+		assign_preorder_uids_rec(klass);
+}
+
 static void lower_node(ir_node *node, void *env)
 {
 	(void)env;
@@ -563,6 +671,85 @@ ddispatch_interface_call oo_get_interface_call_type()
 	return interface_call_type;
 }
 
+void oo_set_inline_cache_size(unsigned size)
+{
+	assert(size > 0);
+	inline_cache_size = size;
+}
+
+unsigned oo_get_inline_cache_size(void)
+{
+	return inline_cache_size;
+}
+
+void oo_set_inline_cache_stats(bool enable)
+{
+	inline_cache_stats = enable;
+}
+
+bool oo_get_inline_cache_stats(void)
+{
+	return inline_cache_stats;
+}
+
+void oo_set_interface_coloring(bool enable)
+{
+	interface_coloring = enable;
+}
+
+bool oo_get_interface_coloring(void)
+{
+	return interface_coloring;
+}
+
+void oo_set_relative_vtables(bool enable)
+{
+	relative_vtables = enable;
+}
+
+bool oo_get_relative_vtables(void)
+{
+	return relative_vtables;
+}
+
+void oo_set_embedded_itts(unsigned n_slots)
+{
+	embedded_itts = n_slots;
+}
+
+unsigned oo_get_embedded_itts(void)
+{
+	return embedded_itts;
+}
+
+void oo_set_closed_world(bool enable)
+{
+	closed_world = enable;
+}
+
+bool oo_get_closed_world(void)
+{
+	return closed_world;
+}
+
+void oo_set_preorder_class_uids(bool enable)
+{
+	preorder_class_uids = enable;
+}
+
+bool oo_get_preorder_class_uids(void)
+{
+	return preorder_class_uids;
+}
+
+void oo_assign_preorder_class_uids(void)
+{
+	/* start at 1, a max_subclass_uid of 0 marks unnumbered classes */
+	next_preorder_uid = 1;
+	++preorder_numbering;
+	class_walk_super2sub(assign_preorder_uid_proxy, NULL, NULL);
+}
+
 void oo_init(void)
 {
 	obstack_init(&oo_info_obst);
@@ -585,13 +772,29 @@ void oo_deinit(void)
 
 void oo_lower(void)
 {
+	if (oo_get_closed_world())
+		(void)oo_infer_final();
 
-	ddispatch_interface_call call_type = oo_get_interface_call_type();
+	if (oo_get_preorder_class_uids())
+		oo_assign_preorder_class_uids();
+
+	ddispatch_interface_call call_type = oo_get_interface_call_type() & ~call_inline_cache;
 	if ((call_type & call_searched_itable) == call_searched_itable ||
 		call_type == call_itable_indexed) {
+		if (call_type == call_itable_indexed && oo_get_interface_coloring()) {
+			size_t saved = ddispatch_color_interfaces();
+#ifdef OO_STATS
+			printf("ITT bytes saved by interface coloring: %lu\n", (unsigned long)saved);
+#else
+			(void)saved;
+#endif
+		}
 		class_walk_super2sub(setup_itable_proxy, NULL, NULL);
 	}
 
+	if (call_type == call_row_displacement)
+		ddispatch_setup_dispatch_table();
+
 	class_walk_super2sub(setup_vtable_proxy, NULL, NULL);
 	class_walk_super2sub(construct_runtime_typeinfo_proxy, NULL, NULL);
 
@@ -599,6 +802,8 @@ void oo_lower(void)
 	for (int i = 0; i < n_irgs; ++i) {
 		ir_graph *irg = get_irp_irg(i);
 		irg_walk_graph(irg, NULL, lower_node, NULL);
+		ddispatch_lower_deferred_calls(irg);
+		rtti_lower_deferred_instanceofs(irg);
 	}
 
 	class_walk_super2sub(lower_type, NULL, NULL);
@@ -4,16 +4,30 @@
 #include <libfirm/tv.h>
 #include <libfirm/typerep.h>
 #include <libfirm/irop.h>
+#include <libfirm/irgwalk.h>
+#include <libfirm/irprog.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "adt/util.h"
 #include "liboo/nodes.h"
+#include "liboo/oo.h"
 #include "liboo/opt.h"
+#include "liboo/ddispatch.h"
 
 static bool is_subtype(ir_type *test, ir_type *type)
 {
 	if (test == type)
 		return true;
+	/* preorder uids: subclasses of type are numbered [uid, max_subclass_uid]
+	 * if both were numbered together */
+	unsigned numbering = oo_get_class_preorder_numbering(type);
+	if (numbering != 0 && oo_get_class_preorder_numbering(test) == numbering
+	    && !oo_get_class_is_interface(type)) {
+		unsigned uid     = oo_get_class_preorder_uid(type);
+		unsigned max_uid = oo_get_class_max_subclass_uid(type);
+		return oo_get_class_preorder_uid(test) - uid <= max_uid - uid;
+	}
 	for (size_t i = 0, n = get_class_n_supertypes(test); i < n; ++i) {
 		ir_type *super = get_class_supertype(test, i);
 		if (is_subtype(super, type))
@@ -59,3 +73,96 @@ void oo_register_opt_funcs(void)
 {
 	set_op_transform_node(op_InstanceOf, transform_node_InstanceOf);
 }
+
+/* inherited copies of a method are no overrides, but their overriders are */
+static bool is_overridden(ir_entity *method)
+{
+	for (size_t i = 0, n = get_entity_n_overwrittenby(method); i < n; ++i) {
+		ir_entity *overrider = get_entity_overwrittenby(method, i);
+		if (!oo_get_method_is_inherited(overrider) || is_overridden(overrider))
+			return true;
+	}
+	return false;
+}
+
+static bool has_extern_subclass(ir_type *klass)
+{
+	for (size_t i = 0, n = get_class_n_subtypes(klass); i < n; ++i) {
+		ir_type *subclass = get_class_subtype(klass, i);
+		if (oo_get_class_is_extern(subclass) || has_extern_subclass(subclass))
+			return true;
+	}
+	return false;
+}
+
+static bool can_bind_statically(ir_entity *method)
+{
+	if (oo_get_method_is_abstract(method))
+		return false;
+
+	ir_type *klass = get_entity_owner(method);
+	if (oo_get_method_is_final(method) || oo_get_class_is_final(klass))
+		return true;
+
+	return !oo_get_class_is_extern(klass) && !has_extern_subclass(klass)
+	    && !is_overridden(method);
+}
+
+static void cha_devirtualize_call(ir_node *node, void *env)
+{
+	size_t *n_bound = (size_t*)env;
+	if (!is_Call(node) || oo_get_call_is_statically_bound(node))
+		return;
+	ir_node *callee = get_Call_ptr(node);
+	if (!is_Proj(callee))
+		return;
+	ir_node *methodsel = get_Proj_pred(callee);
+	if (!is_MethodSel(methodsel))
+		return;
+
+	ir_entity *method = get_MethodSel_entity(methodsel);
+	if (oo_get_entity_binding(method) != bind_dynamic || !can_bind_statically(method))
+		return;
+
+	oo_set_call_is_statically_bound(node, true);
+	++*n_bound;
+}
+
+static void infer_final(ir_type *klass, void *env)
+{
+	size_t *n_marked = (size_t*)env;
+	if (klass == get_glob_type() || oo_get_class_is_interface(klass)
+	    || oo_get_class_is_extern(klass))
+		return;
+
+	if (!oo_get_class_is_final(klass) && get_class_n_subtypes(klass) == 0) {
+		oo_set_class_is_final(klass, true);
+		++*n_marked;
+	}
+
+	for (size_t i = 0, n = get_class_n_members(klass); i < n; ++i) {
+		ir_entity *member = get_class_member(klass, i);
+		if (!is_method_entity(member) || oo_get_method_is_final(member)
+		    || oo_get_method_is_abstract(member) || is_overridden(member))
+			continue;
+		oo_set_method_is_final(member, true);
+		++*n_marked;
+	}
+}
+
+size_t oo_infer_final(void)
+{
+	size_t n_marked = 0;
+	class_walk_super2sub(infer_final, NULL, &n_marked);
+	return n_marked;
+}
+
+size_t oo_cha_devirtualize(void)
+{
+	size_t n_bound = 0;
+	for (size_t i = 0, n = get_irp_n_irgs(); i < n; ++i) {
+		ir_graph *irg = get_irp_irg(i);
+		irg_walk_graph(irg, NULL, cha_devirtualize_call, &n_bound);
+	}
+	return n_bound;
+}
@@ -0,0 +1,103 @@
+#include "rt.h"
+#include "types.h"
+
+#ifdef LIBOO_RT_STATS
+static call_site_cache_t *cache_sites;
+
+static void register_site(call_site_cache_t *cache)
+{
+	call_site_cache_t *head = __atomic_load_n(&cache_sites, __ATOMIC_RELAXED);
+	do {
+		cache->next_site = head;
+	} while (!__atomic_compare_exchange_n(&cache_sites, &head, cache, true,
+	                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void oo_rt_dump_inline_cache_stats(FILE *out)
+{
+	call_site_cache_t *cache = __atomic_load_n(&cache_sites, __ATOMIC_ACQUIRE);
+	for ( ; cache != NULL; cache = cache->next_site) {
+		uint32_t n_used = __atomic_load_n(&cache->n_used, __ATOMIC_RELAXED);
+		fprintf(out, "%s: %u hits, %u misses, %s\n",
+		        get_string_const_chars(cache->site),
+		        (unsigned)__atomic_load_n(&cache->hits, __ATOMIC_RELAXED),
+		        (unsigned)__atomic_load_n(&cache->misses, __ATOMIC_RELAXED),
+		        n_used > cache->size ? "megamorphic" : "cached");
+	}
+}
+#endif
+
+/**
+ * Claims the next free entry of the cache and fills it. Returns NULL if the
+ * call site is (or just became) megamorphic.
+ * Entries are written once, the call site only reaches them through first
+ * or after seeing their vtable, so publishing the vtable with release
+ * semantics is enough.
+ */
+static inline_cache_t *claim_entry(call_site_cache_t *cache,
+                                   const vtable_t *vtable, void *target)
+{
+#ifdef LIBOO_RT_STATS
+	__atomic_fetch_add(&cache->misses, 1, __ATOMIC_RELAXED);
+#endif
+	uint32_t n_used = __atomic_load_n(&cache->n_used, __ATOMIC_RELAXED);
+	do {
+		if (n_used > cache->size)
+			return NULL;
+	} while (!__atomic_compare_exchange_n(&cache->n_used, &n_used, n_used + 1, true,
+	                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+#ifdef LIBOO_RT_STATS
+	if (n_used == 0)
+		register_site(cache);
+#endif
+	if (n_used == cache->size)
+		return NULL;
+
+	inline_cache_t *entry = &cache->entries[n_used];
+	entry->target = target;
+	__atomic_store_n(&entry->vtable, vtable, __ATOMIC_RELEASE);
+	return entry;
+}
+
+void oo_rt_inline_cache_update(call_site_cache_t *cache, const vtable_t *vtable,
+                               void *target)
+{
+	/* a monomorphic cache always checks the most recent entry. The call site
+	 * loads vtable and target through first, so on all supported targets the
+	 * address dependency orders these loads after the load of first. */
+	inline_cache_t *entry = claim_entry(cache, vtable, target);
+	if (entry != NULL)
+		__atomic_store_n(&cache->first, entry, __ATOMIC_RELEASE);
+}
+
+void *oo_rt_polymorphic_cache_lookup(call_site_cache_t *cache,
+                                     const vtable_t *vtable)
+{
+	uint32_t n_used = __atomic_load_n(&cache->n_used, __ATOMIC_RELAXED);
+	if (n_used > cache->size)
+		n_used = cache->size;
+
+	/* the first entry has already been checked by the call site */
+	for (uint32_t i = 1; i < n_used; i++) {
+		inline_cache_t *entry = &cache->entries[i];
+		if (__atomic_load_n(&entry->vtable, __ATOMIC_ACQUIRE) == vtable) {
+#ifdef LIBOO_RT_STATS
+			__atomic_fetch_add(&cache->hits, 1, __ATOMIC_RELAXED);
+#endif
+			return entry->target;
+		}
+	}
+	return NULL;
+}
+
+void oo_rt_polymorphic_cache_update(call_site_cache_t *cache,
+                                    const vtable_t *vtable, void *target)
+{
+	/* a polymorphic cache keeps its first entry inline and searches the
+	 * others. Once all entries are taken the call site no longer calls into
+	 * the runtime. */
+	inline_cache_t *entry = claim_entry(cache, vtable, target);
+	if (entry == &cache->entries[0])
+		__atomic_store_n(&cache->first, entry, __ATOMIC_RELEASE);
+}
@@ -2,22 +2,65 @@
 #include "../adt/error.h"
 #include "rt.h"
 
-bool oo_rt_instanceof(const class_info_t *objclass,
-                      const class_info_t *refclass)
+static bool is_subclass(const class_info_t *objclass,
+                        const class_info_t *refclass)
+{
+	/* preorder uids: subclasses are numbered in [uid, max_subclass_uid], but
+	 * only among the classes numbered together */
+	if (refclass->preorder_numbering != NULL
+	    && objclass->preorder_numbering == refclass->preorder_numbering) {
+		return objclass->preorder_uid - refclass->preorder_uid
+		    <= refclass->max_subclass_uid - refclass->preorder_uid;
+	}
+
+	uint32_t depth = refclass->depth;
+	if (depth < OO_CLASS_DISPLAY_SIZE)
+		return objclass->display[depth] == refclass;
+
+	/* refclass is too deep for the display, walk up to its depth */
+	const class_info_t *k = objclass;
+	while (k != NULL && k->depth > depth)
+		k = k->superclass;
+	return k == refclass;
+}
+
+static bool search_interface(const class_info_t *objclass,
+                             const class_info_t *refclass)
 {
 	if (objclass == refclass)
 		return true;
 
-	if (objclass->superclass && oo_rt_instanceof(objclass->superclass, refclass))
+	if (objclass->superclass && search_interface(objclass->superclass, refclass))
 		return true;
 
-	if (objclass->n_interfaces > 0) {
-		for (uint32_t i = 0; i < objclass->n_interfaces; i++) {
-			class_info_t *ci = objclass->interfaces[i];
-			if (oo_rt_instanceof(ci, refclass))
-				return true;
-		}
+	for (uint32_t i = 0; i < objclass->n_interfaces; i++) {
+		if (search_interface(objclass->interfaces[i], refclass))
+			return true;
 	}
 
 	return false;
 }
+
+static bool implements_interface(const class_info_t *objclass,
+                                 const class_info_t *refclass)
+{
+	/* classes of different compilation units use different indices */
+	if (objclass->interface_numbering != refclass->interface_numbering)
+		return search_interface(objclass, refclass);
+
+	return interface_bits_contain(objclass->interface_bits,
+	                              objclass->n_interface_words,
+	                              refclass->interface_index);
+}
+
+bool oo_rt_instanceof(const class_info_t *objclass,
+                      const class_info_t *refclass)
+{
+	if (objclass == refclass)
+		return true;
+
+	if (refclass->depth != OO_CLASS_DEPTH_INTERFACE)
+		return is_subclass(objclass, refclass);
+
+	return implements_interface(objclass, refclass);
+}
@@ -6,71 +6,223 @@
 
 #define ITT_MOVE2FRONT_AREA 5
 
-void *oo_rt_lookup_interface_method(const class_info_t *klass,
-                                    const string_const_t *method_name)
+/* number of entries in the global lookup cache, must be a power of two */
+#define LOOKUP_CACHE_SIZE 1024
+
+/*
+ * Entries of the global (class, method name) -> funcptr cache. Updates are
+ * published seqlock style: seq is odd while a writer fills the entry, readers
+ * treat an entry as a miss if seq is odd or changed while reading it.
+ * Writers never wait, if an entry is busy the update is simply dropped.
+ */
+typedef struct {
+	uintptr_t             seq;
+	const class_info_t   *klass;
+	const string_const_t *method_name;
+	void                 *funcptr;
+} lookup_cache_entry_t;
+
+static lookup_cache_entry_t lookup_cache[LOOKUP_CACHE_SIZE];
+
+#ifdef LIBOO_RT_STATS
+static uint64_t lookup_cache_hits;
+static uint64_t lookup_cache_misses;
+
+uint64_t oo_rt_lookup_cache_hits(void)
+{
+	return __atomic_load_n(&lookup_cache_hits, __ATOMIC_RELAXED);
+}
+
+uint64_t oo_rt_lookup_cache_misses(void)
 {
-	const class_info_t *k = klass;
-	do {
-		for (uint32_t i = 0; i < k->n_methods; i++) {
-			const method_info_t *method = &k->methods[i];
+	return __atomic_load_n(&lookup_cache_misses, __ATOMIC_RELAXED);
+}
+#endif
+
+static lookup_cache_entry_t *get_lookup_cache_entry(const class_info_t *klass,
+                                                    const string_const_t *method_name)
+{
+	uintptr_t hash = ((uintptr_t)klass >> 4) ^ method_name->hash;
+	return &lookup_cache[hash & (LOOKUP_CACHE_SIZE - 1)];
+}
+
+static void *lookup_cache_find(const class_info_t *klass,
+                               const string_const_t *method_name)
+{
+	lookup_cache_entry_t *entry = get_lookup_cache_entry(klass, method_name);
+
+	uintptr_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+	if (seq & 1)
+		return NULL;
+	const class_info_t   *k       = __atomic_load_n(&entry->klass, __ATOMIC_RELAXED);
+	const string_const_t *name    = __atomic_load_n(&entry->method_name, __ATOMIC_RELAXED);
+	void                 *funcptr = __atomic_load_n(&entry->funcptr, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq)
+		return NULL;
+
+	if (k != klass || name != method_name)
+		return NULL;
+	return funcptr;
+}
+
+static void lookup_cache_insert(const class_info_t *klass,
+                                const string_const_t *method_name,
+                                void *funcptr)
+{
+	lookup_cache_entry_t *entry = get_lookup_cache_entry(klass, method_name);
+
+	uintptr_t seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+	if (seq & 1)
+		return;
+	if (!__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, false,
+	                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&entry->klass, klass, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->method_name, method_name, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->funcptr, funcptr, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void *search_method_index(const class_info_t *klass,
+                                 const string_const_t *method_name)
+{
+	// the index contains inherited methods as well and always has at least
+	// one empty slot, so probing terminates
+	if (klass->method_index_size > 0) {
+		uint32_t mask = klass->method_index_size - 1;
+		for (uint32_t i = method_name->hash & mask; ; i = (i + 1) & mask) {
+			const method_info_t *method = &klass->method_index[i];
+			if (method->name == NULL)
+				break;
 			if (string_const_equals(method->name, method_name)) {
 				return method->funcptr;
 			}
 		}
-		// not found, try the superclass
-		k = k->superclass;
-	} while (k != NULL);
-
-	panic("Interface lookup for %s in %s failed", get_string_const_chars(method_name), get_string_const_chars(klass->name));
+	}
+	return NULL;
 }
 
-void *oo_searched_itable_method_m2f(const object_t *obj, void *interface_id, int32_t offset)
+void *oo_rt_lookup_interface_method(const class_info_t *klass,
+                                    const string_const_t *method_name)
 {
-	itt_entry_t *itt = obj->vptr->itt;
+	void *funcptr = lookup_cache_find(klass, method_name);
+	if (funcptr != NULL) {
+#ifdef LIBOO_RT_STATS
+		__atomic_fetch_add(&lookup_cache_hits, 1, __ATOMIC_RELAXED);
+#endif
+		return funcptr;
+	}
+#ifdef LIBOO_RT_STATS
+	__atomic_fetch_add(&lookup_cache_misses, 1, __ATOMIC_RELAXED);
+#endif
 
-	int32_t i = itt[0].next;
+	funcptr = search_method_index(klass, method_name);
+	if (funcptr != NULL) {
+		lookup_cache_insert(klass, method_name, funcptr);
+		return funcptr;
+	}
 
-	int32_t counter = 1;
-	do {
-		if (itt[i].id == interface_id) {
-			void *method = itt[i].itable[offset];
+	panic("Interface lookup for %s in %s failed", get_string_const_chars(method_name), get_string_const_chars(klass->name));
+}
 
-			if (counter > ITT_MOVE2FRONT_AREA) {
-				if (itt[i].prev > 0)
-					itt[itt[i].prev].next = itt[i].next;
-				if (itt[i].next > 0)
-					itt[itt[i].next].prev = itt[i].prev;
+void *oo_rt_imt_resolve(const void *conflicts, const string_const_t *method_name)
+{
+	/* IMT slots shared by several methods hold the address of a NULL
+	 * terminated (name, funcptr) table, see the conflict mask of the vtable */
+	const method_info_t *method = (const method_info_t*)conflicts;
+	for ( ; method->name != NULL; method++) {
+		if (string_const_equals(method->name, method_name))
+			return method->funcptr;
+	}
 
-				itt[itt[0].next].prev = i;
-				itt[i].next = itt[0].next;
+	panic("IMT lookup for %s failed", get_string_const_chars(method_name));
+}
 
-				itt[0].next = i;
-				itt[i].prev = 0;
-			}
+/* ITTs with at most this many entries are searched linearly */
+#define ITT_LINEAR_SEARCH_LIMIT 8
 
-			return method;
+/*
+ * Entries of searched ITTs are sorted by key, the header's itable field
+ * points to the packed keys: the number of entries followed by the key of
+ * every entry. Keys may collide, so the ids of all entries with the
+ * requested key are compared. Returns the index of the entry or 0.
+ */
+static int32_t search_itt(const itt_entry_t *itt, const void *interface_id,
+                          uint32_t key)
+{
+	const uint32_t *keys = (const uint32_t*)itt[0].itable;
+	uint32_t        n    = keys[0];
+
+	if (n <= ITT_LINEAR_SEARCH_LIMIT) {
+		for (uint32_t i = 1; i <= n; i++) {
+			if (itt[i].id == interface_id)
+				return i;
 		}
-		counter++;
+		return 0;
 	}
-	while ((i = itt[i].next) > 0);
 
-	panic("itable not found");
+	// lower bound of key in keys[1..n]
+	uint32_t lo = 1;
+	uint32_t hi = n + 1;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (keys[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for ( ; lo <= n && keys[lo] == key; lo++) {
+		if (itt[lo].id == interface_id)
+			return lo;
+	}
+	return 0;
 }
 
-void *oo_searched_itable_method(const object_t *obj, void *interface_id, int32_t offset)
+/*
+ * The entries of an ITT are never modified, so concurrent lookups only share
+ * the two most-recently-used hints kept in prev/next of the ITT header
+ * (entry 0). Hints are plain atomic stores, a lost or stale update only costs
+ * an additional search, never a wrong result.
+ */
+void *oo_searched_itable_method_m2f(const object_t *obj, void *interface_id,
+                                    uint32_t key, int32_t offset)
 {
 	itt_entry_t *itt = obj->vptr->itt;
 
-	int32_t i = 1;
+	int32_t mru = __atomic_load_n(&itt[0].next, __ATOMIC_RELAXED);
+	if (itt[mru].id == interface_id)
+		return itt[mru].itable[offset];
 
-	int32_t counter = 1;
-	do {
-		if (itt[i].id == interface_id) {
-			return itt[i].itable[offset];
-		}
-		counter++;
+	int32_t second = __atomic_load_n(&itt[0].prev, __ATOMIC_RELAXED);
+	if (itt[second].id == interface_id) {
+		__atomic_store_n(&itt[0].prev, mru, __ATOMIC_RELAXED);
+		__atomic_store_n(&itt[0].next, second, __ATOMIC_RELAXED);
+		return itt[second].itable[offset];
 	}
-	while (itt[++i].id != NULL);
 
-	panic("itable not found");
+	int32_t i = search_itt(itt, interface_id, key);
+	if (i == 0)
+		panic("itable not found");
+
+	if (i > ITT_MOVE2FRONT_AREA) {
+		__atomic_store_n(&itt[0].prev, mru, __ATOMIC_RELAXED);
+		__atomic_store_n(&itt[0].next, i, __ATOMIC_RELAXED);
+	}
+	return itt[i].itable[offset];
+}
+
+void *oo_searched_itable_method(const object_t *obj, void *interface_id,
+                                uint32_t key, int32_t offset)
+{
+	itt_entry_t *itt = obj->vptr->itt;
+
+	int32_t i = search_itt(itt, interface_id, key);
+	if (i == 0)
+		panic("itable not found");
+
+	return itt[i].itable[offset];
 }
@@ -2,6 +2,7 @@
 #define LIBOO_RT_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "liboo/rts_types.h"
 #include "types.h"
 
@@ -13,8 +14,26 @@ bool oo_rt_instanceof(const class_info_t *objclass,
                       const class_info_t *refclass);
 void *oo_rt_lookup_interface_method(const class_info_t *klass,
                                     const string_const_t *method_name);
+#ifdef LIBOO_RT_STATS
+/* statistics of the global cache used by oo_rt_lookup_interface_method */
+uint64_t oo_rt_lookup_cache_hits(void);
+uint64_t oo_rt_lookup_cache_misses(void);
+#endif
+void *oo_rt_imt_resolve(const void *conflicts, const string_const_t *method_name);
 void *oo_searched_itable_method(const object_t *obj, void *interface_id,
-                                int32_t offset);
+                                uint32_t key, int32_t offset);
 void *oo_searched_itable_method_m2f(const object_t *obj, void *interface_id,
-                                    int32_t offset);
+                                    uint32_t key, int32_t offset);
+void oo_rt_inline_cache_update(call_site_cache_t *cache, const vtable_t *vtable,
+                               void *target);
+void *oo_rt_polymorphic_cache_lookup(call_site_cache_t *cache,
+                                     const vtable_t *vtable);
+void oo_rt_polymorphic_cache_update(call_site_cache_t *cache,
+                                    const vtable_t *vtable, void *target);
+#ifdef LIBOO_RT_STATS
+/* print hits, misses and state of every call site cache that has been used.
+ * Hits of the inline checked pair are only counted if the call sites were
+ * compiled with oo_set_inline_cache_stats. */
+void oo_rt_dump_inline_cache_stats(FILE *out);
+#endif
 #endif
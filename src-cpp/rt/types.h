@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "liboo/rts_types.h"
 
 struct rtti_t {
 	void *dummy;
@@ -30,4 +31,27 @@ struct object_t {
 };
 typedef struct object_t object_t;
 
+/* (vtable, target) pair of a call site cache, never changed once published */
+struct inline_cache_t {
+	const vtable_t *vtable;
+	void           *target;
+};
+typedef struct inline_cache_t inline_cache_t;
+
+/* per call site cache, see call_inline_cache. The call site checks the pair
+ * first points to inline; first initially points to an empty pair and is only
+ * set to completely written entries. n_used counts the claimed entries,
+ * size + 1 marks a megamorphic call site. */
+struct call_site_cache_t {
+	const inline_cache_t     *first;
+	uint32_t                  n_used;
+	uint32_t                  size;
+	const string_const_t     *site;
+	struct call_site_cache_t *next_site;
+	uint32_t                  hits;
+	uint32_t                  misses;
+	inline_cache_t            entries[];
+};
+typedef struct call_site_cache_t call_site_cache_t;
+
 #endif
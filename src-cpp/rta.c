@@ -15,15 +15,22 @@
 #include <assert.h>
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <liboo/oo.h>
 #include <liboo/nodes.h>
+#include <liboo/ddispatch.h>
 
 #include "adt/cpmap.h"
 #include "adt/cpset.h"
 #include "adt/pdeq.h"
 #include "adt/hashptr.h"
+#include "adt/obst.h"
+#include "adt/raw_bitset.h"
+#include "adt/util.h"
+#include "adt/xmalloc.h"
+#include "libfirm/adt/pmap.h"
 
 
 // debug setting
@@ -87,22 +94,117 @@ static ir_entity *default_detect_call(ir_node *call) { (void)call; return NULL;
 
 static ir_entity *(*detect_call)(ir_node *call) = &default_detect_call;
 
+static unsigned type_switch_limit = 1;
+static bool per_method_type_sets = false;
+
+static unsigned n_method_ids; // number of methods numbered by number_classes_and_methods
+static unsigned n_class_ids; // number of classes numbered by number_classes_and_methods
+static pmap *method_ids; // method entity -> id+1, valid during rta_optimization
+static pmap *class_ids; // class type -> id+1, valid during rta_optimization
+
 void rta_set_detection_callbacks(ir_entity *(*detect_call_callback)(ir_node *call))
 {
 	assert(detect_call_callback);
 	detect_call = detect_call_callback;
 }
 
+void rta_set_type_switch_limit(unsigned limit)
+{
+	type_switch_limit = limit;
+}
+
+void rta_set_per_method_type_sets(bool enable)
+{
+	per_method_type_sets = enable;
+}
+
+
+// methods and classes are numbered densely for the duration of rta_optimization, the ids are kept in side tables because liboo itself owns the entity and type links
+static void number_members(ir_type *owner)
+{
+	for (size_t i=0, n=get_compound_n_members(owner); i<n; i++) {
+		ir_entity *member = get_compound_member(owner, i);
+		if (is_method_entity(member))
+			pmap_insert(method_ids, member, INT_TO_PTR(++n_method_ids));
+	}
+}
+
+static void number_class_and_methods(ir_type *klass, void *env)
+{
+	(void)env;
+	if (klass == get_glob_type()) return;
+	pmap_insert(class_ids, klass, INT_TO_PTR(++n_class_ids));
+	number_members(klass);
+}
+
+static void number_classes_and_methods(void)
+{
+	n_method_ids = 0;
+	n_class_ids = 0;
+	method_ids = pmap_create();
+	class_ids = pmap_create();
+	number_members(get_glob_type());
+	class_walk_super2sub(number_class_and_methods, NULL, NULL);
+}
+
+static void free_class_and_method_ids(void)
+{
+	pmap_destroy(method_ids);
+	pmap_destroy(class_ids);
+	method_ids = NULL;
+	class_ids = NULL;
+}
+
+static unsigned get_method_id(const ir_entity *method)
+{
+	size_t id = PTR_TO_INT(pmap_get(void, method_ids, method));
+	assert(id > 0 && id <= n_method_ids && "method is no member of a class or the global type");
+	return (unsigned)id - 1;
+}
+
+static unsigned get_class_id(const ir_type *klass)
+{
+	size_t id = PTR_TO_INT(pmap_get(void, class_ids, klass));
+	assert(id > 0 && id <= n_class_ids);
+	return (unsigned)id - 1;
+}
+
+
+typedef struct unused_target {
+	ir_entity *method; // potential call target that is unused as long as its class is not live
+	ir_entity *call_entity; // call entity that would call it
+	struct unused_target *next;
+} unused_target;
 
 typedef struct analyzer_env {
-	pdeq *workqueue; // workqueue for the run over the (reduced) callgraph
-	cpset_t *done_set; // set to mark methods that were already analyzed
+	pdeq *workqueue; // workqueue for the run over the (reduced) callgraph, NULL to just collect targets (see xta_resolve_dyncall)
+	unsigned *done_set; // bitset of method ids to mark methods that were already analyzed, NULL if none were
 	cpset_t *live_classes; // live classes found by examining object creation (external classes are left out and always considered as live)
+	unsigned *live_class_set; // bitset of class ids of live_classes for fast lookup, NULL to look up live_classes itself (see xta_resolve_dyncall)
 	cpset_t *live_methods; // live method entities
+	unsigned *live_method_set; // bitset of method ids of live_methods to insert each one only once
 	cpmap_t *dyncall_targets; // map that stores the set of potential call targets for every method entity appearing in a dynamically bound call (Map: call entity -> Set: method entities)
-	cpmap_t *unused_targets; // map that stores a map for every class which stores unused potential call targets of dynamic calls and a set of the call entities that would call them if the class were live) (Map: class -> (Map: method entity -> Set: call entities)) This is needed to update results when a class becomes live after there were already some dynamically bound calls that would call a method of it.
+	unused_target **unused_targets; // array that stores a list for every class id of unused potential call targets of dynamic calls together with the call entities that would call them if the class were live. This is needed to update results when a class becomes live after there were already some dynamically bound calls that would call a method of it. NULL if nothing needs to be memorized (see xta_resolve_dyncall).
+	struct obstack *obst; // arena for the unused_targets lists
+	pdeq *dyncalls; // dynamically bound Call nodes of the analyzed graphs for rta_devirtualize_calls, NULL if not walking graphs
 } analyzer_env;
 
+static void add_live_method(ir_entity *method, analyzer_env *env)
+{
+	unsigned id = get_method_id(method);
+	if (!rbitset_is_set(env->live_method_set, id)) {
+		rbitset_set(env->live_method_set, id);
+		cpset_insert(env->live_methods, method);
+	}
+}
+
+static bool is_live_class(ir_type *klass, analyzer_env *env)
+{
+	if (env->live_class_set == NULL)
+		return cpset_find(env->live_classes, klass) != NULL;
+	return rbitset_is_set(env->live_class_set, get_class_id(klass));
+}
+
 
 static void add_to_workqueue(ir_entity *method, analyzer_env *env); // forward declaration
 
@@ -123,7 +225,7 @@ static void check_for_external_superclasses_recursive(ir_type *klass, ir_type* s
 			if (oo_get_method_is_final(member)) continue;
 			ir_entity *overwriting = get_class_member_by_name(klass, get_entity_ident(member)); // note: This only works because whole signature is already encoded in entity name!
 			if (overwriting != NULL) { //FIXME constructors should be skipped but no frontend independent notion of constructors in liboo
-				cpset_insert(env->live_methods, overwriting);
+				add_live_method(overwriting, env);
 				add_to_workqueue(overwriting, env);
 			}
 		}
@@ -153,31 +255,25 @@ static void check_for_external_superclasses(ir_type *klass, analyzer_env *env)
 	}
 }
 
-// add method entity to target sets of all call entities
-static void add_to_dyncalls(ir_entity *method, cpset_t *call_entities, analyzer_env *env)
+// add method entity to target set of the call entity
+static void add_to_dyncalls(ir_entity *method, ir_entity *call_entity, analyzer_env *env)
 {
 	assert(is_method_entity(method));
-	assert(call_entities);
+	assert(is_method_entity(call_entity));
 	assert(env);
 
-	cpset_iterator_t iterator;
-	cpset_iterator_init(&iterator, call_entities);
-	ir_entity *call_entity;
-	while ((call_entity = cpset_iterator_next(&iterator)) != NULL) {
-		cpset_t *targets = cpmap_find(env->dyncall_targets, call_entity);
-		assert(targets != NULL);
-		//assert(cpset_find(targets, method) == NULL); // doesn't make sense!?
+	cpset_t *targets = cpmap_find(env->dyncall_targets, call_entity);
+	assert(targets != NULL);
 
-		DEBUGOUT("\t\t\t\t\tupdating method %s.%s for call %s.%s\n", get_compound_name(get_entity_owner(method)), get_entity_name(method), get_compound_name(get_entity_owner(call_entity)), get_entity_name(call_entity));
-		// add to targets set
-		cpset_insert(targets, method);
+	DEBUGOUT("\t\t\t\t\tupdating method %s.%s for call %s.%s\n", get_compound_name(get_entity_owner(method)), get_entity_name(method), get_compound_name(get_entity_owner(call_entity)), get_entity_name(call_entity));
+	// add to targets set
+	cpset_insert(targets, method);
 
-		// add to live methods
-		cpset_insert(env->live_methods, method);
+	// add to live methods
+	add_live_method(method, env);
 
-		// add to workqueue
-		add_to_workqueue(method, env);
-	}
+	// add to workqueue
+	add_to_workqueue(method, env);
 }
 
 static void add_new_live_class(ir_type *klass, analyzer_env *env)
@@ -185,34 +281,18 @@ static void add_new_live_class(ir_type *klass, analyzer_env *env)
 	assert(is_Class_type(klass));
 	assert(env);
 
-	if (cpset_find(env->live_classes, klass) == NULL // if it had not already been added
+	if (!is_live_class(klass, env) // if it had not already been added
 	    && !oo_get_class_is_extern(klass) && !oo_get_class_is_abstract(klass)) { // if not extern and not abstract
 		// add to live classes
 		cpset_insert(env->live_classes, klass);
+		rbitset_set(env->live_class_set, get_class_id(klass));
 		DEBUGOUT("\t\t\t\t\tadded new live class %s\n", get_compound_name(klass));
 
-		// update existing results
-		cpmap_t *methods = cpmap_find(env->unused_targets, klass);
-		if (methods != NULL) {
-			{
-				cpmap_iterator_t iterator;
-				cpmap_iterator_init(&iterator, methods);
-				cpmap_entry_t entry;
-				while ((entry = cpmap_iterator_next(&iterator)).key != NULL || entry.data != NULL) {
-					ir_entity *method = (ir_entity*)entry.key;
-					cpset_t *call_entities = entry.data;
-
-					add_to_dyncalls(method, call_entities, env);
-
-					cpmap_remove_iterator(methods, &iterator);
-					cpset_destroy(call_entities);
-					free(call_entities);
-				}
-			}
-			cpmap_remove(env->unused_targets, klass);
-			cpmap_destroy(methods);
-			free(methods);
-		}
+		// update existing results, the list itself stays on the obstack
+		unused_target **unused = &env->unused_targets[get_class_id(klass)];
+		for (unused_target *target = *unused; target != NULL; target = target->next)
+			add_to_dyncalls(target->method, target->call_entity, env);
+		*unused = NULL;
 
 		check_for_external_superclasses(klass, env);
 	}
@@ -225,17 +305,12 @@ static void memorize_unused_target(ir_type *klass, ir_entity *entity, ir_entity
 	assert(is_method_entity(call_entity));
 	assert(env);
 
-	cpmap_t *methods = cpmap_find(env->unused_targets, klass);
-	if (methods == NULL) {
-		methods = new_cpmap(hash_ptr, ptr_equals);
-		cpmap_set(env->unused_targets, klass, methods);
-	}
-	cpset_t *call_entities = cpmap_find(methods, entity);
-	if (call_entities == NULL) {
-		call_entities = new_cpset(hash_ptr, ptr_equals);
-		cpmap_set(methods, entity, call_entities);
-	}
-	cpset_insert(call_entities, call_entity);
+	unused_target **unused = &env->unused_targets[get_class_id(klass)];
+	unused_target *target = OALLOC(env->obst, unused_target);
+	target->method = entity;
+	target->call_entity = call_entity;
+	target->next = *unused;
+	*unused = target;
 }
 
 static ir_entity *find_entity_by_ldname(ident *ldname) {
@@ -285,7 +360,7 @@ static void analyzer_handle_no_graph(ir_entity *entity, analyzer_env *env)
 	ir_entity *target = get_ldname_redirect(entity);
 	if (target != NULL) { // if redirection target exists
 		DEBUGOUT("\t\t\t\tentity seems to redirect to different function via the linker name: %s.%s ( %s )\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), get_entity_ld_name(entity));
-		cpset_insert(env->live_methods, target);
+		add_live_method(target, env);
 		add_to_workqueue(target, env);
 		return; // don't do anything else afterwards in this function
 	}
@@ -304,7 +379,9 @@ static void add_to_workqueue(ir_entity *entity, analyzer_env *env)
 	assert(is_method_entity(entity));
 	assert(env);
 
-	if (cpset_find(env->done_set, entity) == NULL) { // only enqueue if not already done
+	if (env->workqueue == NULL) return; // just collecting
+
+	if (env->done_set == NULL || !rbitset_is_set(env->done_set, get_method_id(entity))) { // only enqueue if not already done
 		DEBUGOUT("\t\t\tadding %s.%s ( %s ) [%s] to workqueue\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), get_entity_ld_name(entity), ((get_entity_irg(entity)) ? "graph" : "nograph"));
 		pdeq_putr(env->workqueue, entity);
 	}
@@ -320,7 +397,7 @@ static void take_entity(ir_entity *entity, cpset_t *result_set, analyzer_env *en
 		DEBUGOUT("\t\t\ttaking entity %s.%s ( %s )\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), get_entity_ld_name(entity));
 
 		// add to live methods
-		cpset_insert(env->live_methods, entity);
+		add_live_method(entity, env);
 
 		// add to result set
 		cpset_insert(result_set, entity);
@@ -450,11 +527,13 @@ static void collect_methods_recursive(ir_entity *call_entity, ir_type *klass, ir
 	}
 
 	if (!oo_get_method_is_abstract(current_entity)) { // ignore abstract methods
-		if (cpset_find(env->live_classes, klass) != NULL || oo_get_class_is_extern(klass) || JUST_CHA) { // if class is considered in use
+		if (is_live_class(klass, env) || oo_get_class_is_extern(klass) || JUST_CHA) { // if class is considered in use
 			take_entity(current_entity, result_set, env);
 		} else {
-			DEBUGOUT("\t\t\tclass not in use, memorizing %s.%s %s\n", get_compound_name(get_entity_owner(current_entity)), get_entity_name(current_entity), ((get_entity_irg(current_entity)) ? "G" : "N"));
-			memorize_unused_target(klass, current_entity, call_entity, env); // remember entity with this class for patching if this class will become used
+			if (env->unused_targets != NULL) {
+				DEBUGOUT("\t\t\tclass not in use, memorizing %s.%s %s\n", get_compound_name(get_entity_owner(current_entity)), get_entity_name(current_entity), ((get_entity_irg(current_entity)) ? "G" : "N"));
+				memorize_unused_target(klass, current_entity, call_entity, env); // remember entity with this class for patching if this class will become used
+			}
 		}
 	} else {
 		DEBUGOUT("\t\t\t%s.%s is abstract\n", get_compound_name(get_entity_owner(current_entity)), get_entity_name(current_entity));
@@ -487,7 +566,7 @@ static void analyzer_handle_static_call(ir_node *call, ir_entity *entity, analyz
 	DEBUGOUT("\tstatic call: %s.%s %s\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), gdb_node_helper(entity));
 
 	// add to live methods
-	cpset_insert(env->live_methods, entity);
+	add_live_method(entity, env);
 
 	add_to_workqueue(entity, env);
 
@@ -501,7 +580,7 @@ static void analyzer_handle_static_call(ir_node *call, ir_entity *entity, analyz
 			assert(is_method_entity(called_method));
 			//assert(get_entity_irg(called_method)); // can be external
 			DEBUGOUT("\t\texternal method calls %s.%s ( %s )\n", get_compound_name(get_entity_owner(called_method)), get_entity_name(called_method), get_entity_ld_name(called_method));
-			cpset_insert(env->live_methods, called_method);
+			add_live_method(called_method, env);
 			add_to_workqueue(called_method, env);
 		}
 	}
@@ -517,6 +596,9 @@ static void analyzer_handle_dynamic_call(ir_node *call, ir_entity *entity, analy
 
 	DEBUGOUT("\tdynamic call: %s.%s %s\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), gdb_node_helper(entity));
 
+	// remember the call for devirtualization to avoid walking the graph again
+	pdeq_putr(env->dyncalls, call);
+
 	if (cpmap_find(env->dyncall_targets, entity) == NULL) { // if not already done
 		// calculate set of all method entities that this call could potentially call
 
@@ -548,7 +630,7 @@ static void walk_callgraph_and_analyze(ir_node *node, void *environment)
 			DEBUGOUT("\t\tcould be address taken, so it could be called\n");
 
 			// add to live methods
-			cpset_insert(env->live_methods, entity);
+			add_live_method(entity, env);
 
 			add_to_workqueue(entity, env);
 		}
@@ -611,34 +693,39 @@ static void walk_callgraph_and_analyze(ir_node *node, void *environment)
  * @param initial_live_classes NULL-terminated array of classes that should always be considered live, may be NULL
  * @param live_classes give pointer to empty uninitialized set for receiving results, This is where all live classes are put (as ir_type*).
  * @param live_methods give pointer to empty uninitialized set for receiving results, This is where all live methods are put (as ir_entity*).
- * @param dyncall_targets give pointer to empty uninitialized map for receiving results, This is where call entities are mapped to their actually used potential call targets (ir_entity* -> {ir_entity*}). It's used to optimize dynamically bound calls if possible. (see also function rta_optimize_dyncalls)
+ * @param dyncall_targets give pointer to empty uninitialized map for receiving results, This is where call entities are mapped to their actually used potential call targets (ir_entity* -> {ir_entity*}). It's used to optimize dynamically bound calls if possible. (see also function rta_devirtualize_calls)
+ * @param dyncalls give empty deque for receiving all dynamically bound Call nodes of the analyzed graphs, grouped by graph. It's used by rta_devirtualize_calls instead of walking the graphs again.
  */
-static void rta_run(ir_entity **entry_points, ir_type **initial_live_classes, cpset_t *live_classes, cpset_t *live_methods, cpmap_t *dyncall_targets)
+static void rta_run(ir_entity **entry_points, ir_type **initial_live_classes, cpset_t *live_classes, cpset_t *live_methods, cpmap_t *dyncall_targets, pdeq *dyncalls)
 {
 	assert(entry_points);
 	assert(live_classes);
 	assert(live_methods);
 	assert(dyncall_targets);
+	assert(dyncalls);
 
 	cpset_init(live_classes, hash_ptr, ptr_equals);
 	cpset_init(live_methods, hash_ptr, ptr_equals);
 	cpmap_init(dyncall_targets, hash_ptr, ptr_equals);
 
-	cpmap_t unused_targets;
-	cpmap_init(&unused_targets, hash_ptr, ptr_equals);
+	struct obstack obst;
+	obstack_init(&obst);
 
 	pdeq *workqueue = new_pdeq();
 
-	cpset_t done_set;
-	cpset_init(&done_set, hash_ptr, ptr_equals);
+	unsigned *done_set = rbitset_malloc(n_method_ids);
 
 	analyzer_env env = {
 		.workqueue = workqueue,
-		.done_set = &done_set,
+		.done_set = done_set,
 		.live_classes = live_classes,
+		.live_class_set = rbitset_malloc(n_class_ids),
 		.live_methods = live_methods,
+		.live_method_set = rbitset_malloc(n_method_ids),
 		.dyncall_targets = dyncall_targets,
-		.unused_targets = &unused_targets,
+		.unused_targets = XMALLOCNZ(unused_target*, n_class_ids),
+		.obst = &obst,
+		.dyncalls = dyncalls,
 	};
 
 	{ // add all given entry points to live methods and to workqueue
@@ -648,7 +735,7 @@ static void rta_run(ir_entity **entry_points, ir_type **initial_live_classes, cp
 		for (; (entity = entry_points[i]) != NULL; i++) {
 			assert(is_method_entity(entity));
 			DEBUGOUT("\t%s\n", get_entity_name(entity));
-			cpset_insert(live_methods, entity);
+			add_live_method(entity, &env);
 			// add to workqueue
 			ir_graph *graph = get_entity_irg(entity);
 			assert(graph); // don't give methods without a graph as entry points for the analysis
@@ -665,6 +752,7 @@ static void rta_run(ir_entity **entry_points, ir_type **initial_live_classes, cp
 			assert(is_Class_type(klass));
 			DEBUGOUT("\t%s\n", get_compound_name(klass));
 			cpset_insert(live_classes, klass);
+			rbitset_set(env.live_class_set, get_class_id(klass));
 			check_for_external_superclasses(klass, &env);
 		}
 	}
@@ -673,11 +761,12 @@ static void rta_run(ir_entity **entry_points, ir_type **initial_live_classes, cp
 		ir_entity *entity = pdeq_getl(workqueue);
 		assert(entity && is_method_entity(entity));
 
-		if (cpset_find(&done_set, entity) != NULL) continue;
+		unsigned id = get_method_id(entity);
+		if (rbitset_is_set(done_set, id)) continue;
 
 		DEBUGOUT("\n== %s.%s ( %s )\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), get_entity_ld_name(entity));
 
-		cpset_insert(&done_set, entity); // mark as done _before_ walking to not add it again in case of recursive calls
+		rbitset_set(done_set, id); // mark as done _before_ walking to not add it again in case of recursive calls
 		ir_graph *graph = get_entity_irg(entity);
 		if (graph == NULL) {
 			analyzer_handle_no_graph(entity, &env);
@@ -736,36 +825,487 @@ static void rta_run(ir_entity **entry_points, ir_type **initial_live_classes, cp
 
 	// free data structures
 	del_pdeq(workqueue);
-	cpset_destroy(&done_set);
+	free(done_set);
+	free(env.live_class_set);
+	free(env.live_method_set);
+	free(env.unused_targets);
+	obstack_free(&obst, NULL);
 
-	{ // delete the maps and sets in map unused_targets
-		cpmap_iterator_t iterator;
-		cpmap_iterator_init(&iterator, &unused_targets);
-		cpmap_entry_t entry;
-		while ((entry = cpmap_iterator_next(&iterator)).key != NULL || entry.data != NULL) {
-			cpmap_t* map = entry.data;
-			assert(map);
-
-			cpmap_iterator_t inner_iterator;
-			cpmap_iterator_init(&inner_iterator, map);
-			cpmap_entry_t inner_entry;
-			while ((inner_entry = cpmap_iterator_next(&inner_iterator)).key != NULL || inner_entry.data != NULL) {
-				cpset_t *set = inner_entry.data;
-				assert(set);
-
-				cpmap_remove_iterator(map, &inner_iterator);
-				cpset_destroy(set);
-				free(set);
+	// note: live_classes, live_methods and dyncall_targets are given from outside and return the results, but the sets in map dyncall_targets are allocated in the process and have to be deleted later
+
+}
+
+
+typedef struct xta_method {
+	ir_entity *method;
+	bool summarized; // the sets below up to field_writes are filled
+	bool escapes; // exchanges objects with unknown code (external functions, arrays and static fields, exceptions, callers through function pointers)
+	bool queued; // currently in the workqueue
+	cpset_t types; // classes of objects the method may see
+	cpset_t news; // classes instantiated in the method
+	cpset_t callees; // statically bound callees, for a method without graph the linker name redirection target
+	cpset_t dyncalls; // call entities of the dynamically bound calls
+	cpset_t field_reads; // fields the method loads references from
+	cpset_t field_writes; // fields the method stores references to
+	cpset_t callers; // methods that receive the results of this method (as xta_method*)
+} xta_method;
+
+typedef struct xta_field {
+	cpset_t types; // classes of objects stored in the field
+	cpset_t readers; // methods loading the field (as xta_method*)
+} xta_field;
+
+typedef struct xta_env {
+	pdeq *workqueue; // methods whose type set or callees changed (as xta_method*)
+	cpmap_t methods; // reached methods (Map: method entity -> xta_method)
+	cpmap_t fields; // type sets of fields (Map: field entity -> xta_field)
+	cpset_t unknown; // classes of objects exchanged with unknown code
+	cpset_t escaping; // methods that exchange objects with unknown code (as xta_method*)
+	xta_method *current; // method whose graph is being walked
+	cpset_t *live_classes; // classes instantiated in reached methods
+	cpset_t *live_methods; // reached methods
+	unsigned *live_method_set; // bitset of method ids of live_methods
+	cpmap_t *dyncall_targets; // see analyzer_env
+	pdeq *dyncalls; // see analyzer_env
+} xta_env;
+
+typedef bool (*xta_filter)(ir_type *type, ir_type *klass);
+
+static bool type_accepts(ir_type *type, ir_type *klass)
+{
+	if (is_Pointer_type(type)) {
+		ir_type *points_to = get_pointer_points_to_type(type);
+		return !is_Class_type(points_to) || is_SubClass_of(klass, points_to);
+	}
+	if (is_Primitive_type(type))
+		return mode_is_reference(get_type_mode(type));
+	return true; // compound types can contain references
+}
+
+static bool param_accepts(ir_type *method_type, ir_type *klass)
+{
+	for (size_t i=0, n=get_method_n_params(method_type); i<n; i++) {
+		if (type_accepts(get_method_param_type(method_type, i), klass))
+			return true;
+	}
+	return false;
+}
+
+static bool result_accepts(ir_type *method_type, ir_type *klass)
+{
+	for (size_t i=0, n=get_method_n_ress(method_type); i<n; i++) {
+		if (type_accepts(get_method_res_type(method_type, i), klass))
+			return true;
+	}
+	return false;
+}
+
+// add the classes of from that pass the filter (if any) to the set to, returns whether to changed
+static bool xta_add_types(cpset_t *to, cpset_t *from, xta_filter filter, ir_type *type)
+{
+	bool changed = false;
+	cpset_iterator_t it;
+	cpset_iterator_init(&it, from);
+	ir_type *klass;
+	while ((klass = cpset_iterator_next(&it)) != NULL) {
+		if (cpset_find(to, klass) != NULL) continue;
+		if (filter != NULL && !filter(type, klass)) continue;
+		cpset_insert(to, klass);
+		changed = true;
+	}
+	return changed;
+}
+
+static void xta_enqueue(xta_method *info, xta_env *env)
+{
+	if (!info->queued) {
+		info->queued = true;
+		pdeq_putr(env->workqueue, info);
+	}
+}
+
+static void xta_enqueue_all(cpset_t *methods, xta_env *env)
+{
+	cpset_iterator_t it;
+	cpset_iterator_init(&it, methods);
+	xta_method *info;
+	while ((info = cpset_iterator_next(&it)) != NULL)
+		xta_enqueue(info, env);
+}
+
+// the method itself and its callers have to be processed again after its type set changed
+static void xta_types_changed(xta_method *info, xta_env *env)
+{
+	xta_enqueue(info, env);
+	xta_enqueue_all(&info->callers, env);
+}
+
+static xta_method *xta_reach(ir_entity *method, xta_env *env)
+{
+	assert(is_method_entity(method));
+
+	xta_method *info = cpmap_find(&env->methods, method);
+	if (info == NULL) {
+		DEBUGOUT("\t\t\treaching %s.%s ( %s ) [%s]\n", get_compound_name(get_entity_owner(method)), get_entity_name(method), get_entity_ld_name(method), ((get_entity_irg(method)) ? "graph" : "nograph"));
+		info = XMALLOC(xta_method);
+		info->method = method;
+		info->summarized = false;
+		info->escapes = false;
+		info->queued = false;
+		cpset_init(&info->types, hash_ptr, ptr_equals);
+		cpset_init(&info->news, hash_ptr, ptr_equals);
+		cpset_init(&info->callees, hash_ptr, ptr_equals);
+		cpset_init(&info->dyncalls, hash_ptr, ptr_equals);
+		cpset_init(&info->field_reads, hash_ptr, ptr_equals);
+		cpset_init(&info->field_writes, hash_ptr, ptr_equals);
+		cpset_init(&info->callers, hash_ptr, ptr_equals);
+		cpmap_set(&env->methods, method, info);
+
+		unsigned id = get_method_id(method);
+		if (!rbitset_is_set(env->live_method_set, id)) {
+			rbitset_set(env->live_method_set, id);
+			cpset_insert(env->live_methods, method);
+		}
+		xta_enqueue(info, env);
+	}
+	return info;
+}
+
+static void xta_set_escaping(xta_method *info, xta_env *env)
+{
+	if (!info->escapes) {
+		info->escapes = true;
+		cpset_insert(&env->escaping, info);
+		xta_enqueue(info, env);
+	}
+}
+
+static xta_field *xta_get_field(ir_entity *field, xta_env *env)
+{
+	xta_field *info = cpmap_find(&env->fields, field);
+	if (info == NULL) {
+		info = XMALLOC(xta_field);
+		cpset_init(&info->types, hash_ptr, ptr_equals);
+		cpset_init(&info->readers, hash_ptr, ptr_equals);
+		cpmap_set(&env->fields, field, info);
+	}
+	return info;
+}
+
+static void xta_add_live_class(ir_type *klass, xta_env *env)
+{
+	if (cpset_find(env->live_classes, klass) != NULL) return;
+	cpset_insert(env->live_classes, klass);
+	DEBUGOUT("\t\t\tadded new live class %s\n", get_compound_name(klass));
+
+	// methods overwriting methods of external superclasses can be called by external code with any object it got
+	pdeq *callbacks = new_pdeq();
+	analyzer_env query = {
+		.workqueue = callbacks,
+		.done_set = NULL,
+		.live_classes = env->live_classes,
+		.live_class_set = NULL,
+		.live_methods = env->live_methods,
+		.live_method_set = env->live_method_set,
+		.dyncall_targets = env->dyncall_targets,
+		.unused_targets = NULL,
+		.obst = NULL,
+		.dyncalls = NULL,
+	};
+	check_for_external_superclasses(klass, &query);
+	while (!pdeq_empty(callbacks))
+		xta_set_escaping(xta_reach(pdeq_getl(callbacks), env), env);
+	del_pdeq(callbacks);
+}
+
+static bool is_class_field(ir_node *ptr)
+{
+	if (!is_Member(ptr)) return false;
+	ir_type *owner = get_entity_owner(get_Member_entity(ptr));
+	return is_Class_type(owner) && owner != get_glob_type();
+}
+
+static void walk_graph_and_summarize(ir_node *node, void *environment)
+{
+	xta_env *env = (xta_env*)environment;
+	xta_method *current = env->current;
+
+	// a method whose address is taken for anything but a call could be called from anywhere
+	for (int i=0, n=get_irn_arity(node); i<n; i++) {
+		ir_node *pred = get_irn_n(node, i);
+		if (!is_Address(pred) || !is_method_entity(get_Address_entity(pred))) continue;
+		if (is_Call(node) && i == n_Call_ptr) continue;
+		DEBUGOUT("\taddress taken: %s\n", get_entity_name(get_Address_entity(pred)));
+		xta_set_escaping(xta_reach(get_Address_entity(pred), env), env);
+	}
+
+	if (is_Call(node)) {
+		ir_node *call = node;
+		ir_node *callee = get_irn_n(call, n_Call_ptr);
+		ir_entity *entity = NULL;
+		if (is_Address(callee)) {
+			entity = get_Address_entity(callee);
+		} else if (is_Proj(callee) && is_MethodSel(get_Proj_pred(callee))) {
+			entity = get_MethodSel_entity(get_Proj_pred(callee));
+			if (!oo_get_call_is_statically_bound(call)) {
+				DEBUGOUT("\tdynamic call: %s.%s\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity));
+				cpset_insert(&current->dyncalls, entity);
+				pdeq_putr(env->dyncalls, call);
+				return;
 			}
-			cpmap_remove_iterator(&unused_targets, &iterator);
-			cpmap_destroy(map);
-			free(map);
+		} else {
+			// indirect call via function pointers
+			xta_set_escaping(current, env);
+			return;
+		}
+
+		DEBUGOUT("\tstatic call: %s.%s\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity));
+		cpset_insert(&current->callees, entity);
+		if (get_entity_irg(entity) == NULL) {
+			// hack to detect calls (like class initialization) that are hidden in frontend-specific nodes
+			ir_entity *called_method = detect_call(call);
+			if (called_method != NULL)
+				xta_set_escaping(xta_reach(called_method, env), env);
 		}
+	} else if (is_VptrIsSet(node)) {
+		ir_type *klass = get_VptrIsSet_type(node);
+		assert(is_Class_type(klass));
+		DEBUGOUT("\tVptrIsSet: %s\n", get_compound_name(klass));
+		if (!oo_get_class_is_extern(klass) && !oo_get_class_is_abstract(klass))
+			cpset_insert(&current->news, klass);
+	} else if (is_Load(node)) {
+		if (!mode_is_reference(get_Load_mode(node))) return;
+		ir_node *ptr = get_Load_ptr(node);
+		if (is_class_field(ptr))
+			cpset_insert(&current->field_reads, get_Member_entity(ptr));
+		else
+			xta_set_escaping(current, env); // arrays, static fields, ...
+	} else if (is_Store(node)) {
+		if (!mode_is_reference(get_irn_mode(get_Store_value(node)))) return;
+		ir_node *ptr = get_Store_ptr(node);
+		if (is_class_field(ptr))
+			cpset_insert(&current->field_writes, get_Member_entity(ptr));
+		else
+			xta_set_escaping(current, env);
+	} else if (is_Raise(node) || is_CopyB(node)) {
+		xta_set_escaping(current, env);
 	}
-	cpmap_destroy(&unused_targets);
+}
 
-	// note: live_classes, live_methods and dyncall_targets are given from outside and return the results, but the sets in map dyncall_targets are allocated in the process and have to be deleted later
+static void xta_summarize(xta_method *info, xta_env *env)
+{
+	ir_entity *method = info->method;
+	ir_graph *graph = get_entity_irg(method);
+	DEBUGOUT("\n== %s.%s ( %s )\n", get_compound_name(get_entity_owner(method)), get_entity_name(method), get_entity_ld_name(method));
+
+	if (graph != NULL) {
+		env->current = info;
+		irg_walk_graph(graph, NULL, walk_graph_and_summarize, env);
+		env->current = NULL;
+	} else {
+		// check for redirection to different function via the linker name, otherwise assume external
+		ir_entity *target = get_ldname_redirect(method);
+		if (target != NULL)
+			cpset_insert(&info->callees, target);
+		else
+			xta_set_escaping(info, env);
+	}
+	info->summarized = true;
+}
+
+// arguments flow into the callee's type set, results into the caller's
+static bool xta_flow_call(xta_method *caller, ir_entity *method, xta_env *env)
+{
+	xta_method *callee = xta_reach(method, env);
+	cpset_insert(&callee->callers, caller);
+
+	// filter by the declared types only for methods with graph, external ones could be variadic
+	ir_type *method_type = get_entity_type(method);
+	bool filter = get_entity_irg(method) != NULL;
+	if (xta_add_types(&callee->types, &caller->types, filter ? param_accepts : NULL, method_type))
+		xta_types_changed(callee, env);
+	return xta_add_types(&caller->types, &callee->types, filter ? result_accepts : NULL, method_type);
+}
+
+// resolves the call like RTA does, but with the classes of the calling method as live classes
+static bool xta_resolve_dyncall(xta_method *caller, ir_entity *call_entity, xta_env *env)
+{
+	cpset_t *targets = cpmap_find(env->dyncall_targets, call_entity);
+	if (targets == NULL) {
+		targets = new_cpset(hash_ptr, ptr_equals);
+		cpmap_set(env->dyncall_targets, call_entity, targets);
+	}
+
+	analyzer_env query = {
+		.workqueue = NULL,
+		.done_set = NULL,
+		.live_classes = &caller->types,
+		.live_class_set = NULL,
+		.live_methods = env->live_methods,
+		.live_method_set = env->live_method_set,
+		.dyncall_targets = env->dyncall_targets,
+		.unused_targets = NULL,
+		.obst = NULL,
+		.dyncalls = NULL,
+	};
+	cpset_t result_set;
+	cpset_init(&result_set, hash_ptr, ptr_equals);
+	collect_methods(call_entity, &result_set, &query);
+
+	bool changed = false;
+	cpset_iterator_t it;
+	cpset_iterator_init(&it, &result_set);
+	ir_entity *target;
+	while ((target = cpset_iterator_next(&it)) != NULL) {
+		cpset_insert(targets, target);
+		changed |= xta_flow_call(caller, target, env);
+	}
+	cpset_destroy(&result_set);
+	return changed;
+}
+
+static void xta_process(xta_method *info, xta_env *env)
+{
+	if (!info->summarized)
+		xta_summarize(info, env);
+
+	cpset_iterator_t it;
+	ir_type *klass;
+	cpset_iterator_init(&it, &info->news);
+	while ((klass = cpset_iterator_next(&it)) != NULL)
+		xta_add_live_class(klass, env);
+	bool changed = xta_add_types(&info->types, &info->news, NULL, NULL);
+
+	ir_entity *entity;
+	cpset_iterator_init(&it, &info->callees);
+	while ((entity = cpset_iterator_next(&it)) != NULL)
+		changed |= xta_flow_call(info, entity, env);
+
+	cpset_iterator_init(&it, &info->dyncalls);
+	while ((entity = cpset_iterator_next(&it)) != NULL)
+		changed |= xta_resolve_dyncall(info, entity, env);
+
+	cpset_iterator_init(&it, &info->field_writes);
+	while ((entity = cpset_iterator_next(&it)) != NULL) {
+		xta_field *field = xta_get_field(entity, env);
+		if (xta_add_types(&field->types, &info->types, type_accepts, get_entity_type(entity)))
+			xta_enqueue_all(&field->readers, env);
+	}
+
+	cpset_iterator_init(&it, &info->field_reads);
+	while ((entity = cpset_iterator_next(&it)) != NULL) {
+		xta_field *field = xta_get_field(entity, env);
+		cpset_insert(&field->readers, info);
+		changed |= xta_add_types(&info->types, &field->types, NULL, NULL);
+	}
+
+	if (info->escapes) {
+		if (xta_add_types(&env->unknown, &info->types, NULL, NULL))
+			xta_enqueue_all(&env->escaping, env);
+		changed |= xta_add_types(&info->types, &env->unknown, NULL, NULL);
+	}
+
+	if (changed)
+		xta_types_changed(info, env);
+}
 
+/** run a variant of Rapid Type Analysis with a type set per method and field (XTA)
+ * Classes only flow from the method instantiating them along calls, returns and field stores and loads, so a dynamically bound call only gets the targets for classes that can reach the calling method. Objects exchanged with unknown code (external functions, arrays, static fields and exceptions) share one type set.
+ * @note See the important notes in the documentation of function rta_optimization in the header file! The results have the same form as those of rta_run, the target set of a call entity is the union over all its reached calls.
+ * @param entry_points same as for rta_run
+ * @param initial_live_classes same as for rta_run, these are considered to be exchanged with unknown code
+ * @param live_classes same as for rta_run
+ * @param live_methods same as for rta_run
+ * @param dyncall_targets same as for rta_run
+ * @param dyncalls same as for rta_run
+ */
+static void xta_run(ir_entity **entry_points, ir_type **initial_live_classes, cpset_t *live_classes, cpset_t *live_methods, cpmap_t *dyncall_targets, pdeq *dyncalls)
+{
+	assert(entry_points);
+	assert(live_classes);
+	assert(live_methods);
+	assert(dyncall_targets);
+	assert(dyncalls);
+
+	cpset_init(live_classes, hash_ptr, ptr_equals);
+	cpset_init(live_methods, hash_ptr, ptr_equals);
+	cpmap_init(dyncall_targets, hash_ptr, ptr_equals);
+
+	xta_env env = {
+		.workqueue = new_pdeq(),
+		.current = NULL,
+		.live_classes = live_classes,
+		.live_methods = live_methods,
+		.live_method_set = rbitset_malloc(n_method_ids),
+		.dyncall_targets = dyncall_targets,
+		.dyncalls = dyncalls,
+	};
+	cpmap_init(&env.methods, hash_ptr, ptr_equals);
+	cpmap_init(&env.fields, hash_ptr, ptr_equals);
+	cpset_init(&env.unknown, hash_ptr, ptr_equals);
+	cpset_init(&env.escaping, hash_ptr, ptr_equals);
+
+	{ // entry points are called by unknown code
+		size_t i = 0;
+		ir_entity *entity;
+		for (; (entity = entry_points[i]) != NULL; i++) {
+			assert(get_entity_irg(entity)); // don't give methods without a graph as entry points for the analysis
+			xta_set_escaping(xta_reach(entity, &env), &env);
+		}
+		assert(i > 0 && "give at least one entry point");
+	}
+
+	if (initial_live_classes != NULL) {
+		ir_type *klass;
+		for (size_t i=0; (klass = initial_live_classes[i]) != NULL; i++) {
+			assert(is_Class_type(klass));
+			xta_add_live_class(klass, &env);
+			cpset_insert(&env.unknown, klass);
+		}
+	}
+
+	while (!pdeq_empty(env.workqueue)) {
+		xta_method *info = pdeq_getl(env.workqueue);
+		info->queued = false;
+		xta_process(info, &env);
+	}
+
+	// free data structures
+	{
+		cpmap_iterator_t it;
+		cpmap_iterator_init(&it, &env.methods);
+		cpmap_entry_t entry;
+		while ((entry = cpmap_iterator_next(&it)).key != NULL || entry.data != NULL) {
+			xta_method *info = entry.data;
+			cpset_destroy(&info->types);
+			cpset_destroy(&info->news);
+			cpset_destroy(&info->callees);
+			cpset_destroy(&info->dyncalls);
+			cpset_destroy(&info->field_reads);
+			cpset_destroy(&info->field_writes);
+			cpset_destroy(&info->callers);
+			free(info);
+		}
+	}
+	{
+		cpmap_iterator_t it;
+		cpmap_iterator_init(&it, &env.fields);
+		cpmap_entry_t entry;
+		while ((entry = cpmap_iterator_next(&it)).key != NULL || entry.data != NULL) {
+			xta_field *info = entry.data;
+			cpset_destroy(&info->types);
+			cpset_destroy(&info->readers);
+			free(info);
+		}
+	}
+	del_pdeq(env.workqueue);
+	cpmap_destroy(&env.methods);
+	cpmap_destroy(&env.fields);
+	cpset_destroy(&env.unknown);
+	cpset_destroy(&env.escaping);
+	free(env.live_method_set);
+
+	// note: like with rta_run the sets in map dyncall_targets have to be deleted later
 }
 
 
@@ -800,80 +1340,17 @@ static void rta_dispose_results(cpset_t *live_classes, cpset_t *live_methods, cp
 
 
 typedef struct optimizer_env {
-	pdeq *workqueue; // workqueue for the run over the (reduced) callgraph
-	cpset_t *done_set; // set to mark graphs that were already analyzed
 	cpmap_t *dyncall_targets; // map that stores the set of potential call targets for every method entity appearing in a dynamically bound call (Map: call entity -> Set: method entities)
+	pdeq *type_switch_calls; // calls of the current graph to be split into a type-switch
 #ifdef RTA_STATS
-	unsigned long long n_staticcalls; // number of static calls
 	unsigned long long n_dyncalls; // number of dynamic calls (without interface calls)
 	unsigned long long n_icalls; // number of interface calls
 	unsigned long long n_devirts; // number of devirtualizations of dynamic calls (without interface calls)
 	unsigned long long n_devirts_icalls; // number of devirtualizations of interface calls
-	unsigned long long n_others; // number of other calls (e.g. indirect calls)
+	unsigned long long n_type_switches; // number of dynamic and interface calls split into a type-switch
 #endif
 } optimizer_env;
 
-static void optimizer_add_to_workqueue(ir_entity *method, optimizer_env *env)
-{
-	assert(is_method_entity(method));
-	assert(env);
-
-	if (cpset_find(env->done_set, method) == NULL) { // only enqueue if not already done
-		DEBUGOUT("\t\tadding %s.%s to workqueue\n", get_compound_name(get_entity_owner(method)), get_entity_name(method));
-		pdeq_putr(env->workqueue, method);
-	}
-}
-
-static void optimizer_handle_no_graph(ir_entity *entity, optimizer_env *env)
-{
-	assert(entity);
-	assert(is_method_entity(entity));
-	assert(get_entity_irg(entity) == NULL);
-	assert(env);
-
-	DEBUGOUT("\t\t\thandling method without graph %s.%s ( %s )\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), get_entity_ld_name(entity));
-
-	// check for redirection to different function via the linker name
-	ir_entity *target = get_ldname_redirect(entity);
-	if (target != NULL) { // if redirection target exists
-		DEBUGOUT("\t\t\t\tentity seems to redirect to different function via the linker name: %s.%s ( %s )\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), get_entity_ld_name(entity));
-		optimizer_add_to_workqueue(target, env);
-		return; // don't do anything else afterwards in this function
-	}
-
-	// currently nothing else to do
-}
-
-static void optimizer_handle_static_call(ir_node *call, ir_entity *entity, optimizer_env *env)
-{
-	assert(call);
-	assert(is_Call(call));
-	assert(entity);
-	assert(is_method_entity(entity));
-	assert(env);
-
-	DEBUGOUT("\tstatic call: %s.%s %s\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), gdb_node_helper(entity));
-
-#ifdef RTA_STATS
-	env->n_staticcalls++;
-#endif
-
-	optimizer_add_to_workqueue(entity, env);
-
-
-	// hack to detect calls (like class initialization) that are hidden in frontend-specific nodes
-	ir_graph *graph = get_entity_irg(entity);
-	if (!graph) {
-		ir_entity *called_method = detect_call(call);
-		if (called_method) {
-			assert(is_method_entity(called_method));
-			//assert(get_entity_irg(called_method)); // can be external
-			DEBUGOUT("\t\texternal method calls %s.%s (%s)\n", get_compound_name(get_entity_owner(called_method)), get_entity_name(called_method), get_entity_ld_name(called_method));
-			optimizer_add_to_workqueue(called_method, env);
-		}
-	}
-}
-
 static void optimizer_handle_dynamic_call(ir_node *call, ir_entity *entity, ir_node *methodsel, optimizer_env *env)
 {
 	assert(call);
@@ -920,138 +1397,366 @@ static void optimizer_handle_dynamic_call(ir_node *call, ir_entity *entity, ir_n
 		ir_node *mem = get_irn_n(methodsel, 0);
 		ir_node *input[] = { mem, address };
 		turn_into_tuple(methodsel, 2, input);
+	} else if (cpset_size(targets) >= 2 && cpset_size(targets) <= type_switch_limit && ddispatch_can_split_call(call)) {
+		// needs control flow, see optimizer_lower_type_switches
+		DEBUGOUT("\t\tsplitting call %s.%s into a type-switch over %lu targets\n", get_compound_name(owner), get_entity_name(entity), (unsigned long)cpset_size(targets));
+		pdeq_putr(env->type_switch_calls, call);
 	}
+}
 
-	// add to workqueue
-	cpset_iterator_t it;
-	cpset_iterator_init(&it, targets);
-	ir_entity *target;
-	while ((target = cpset_iterator_next(&it)) != NULL) {
-		optimizer_add_to_workqueue(target, env);
-	}
+static int cmp_entity_ld_name(const void *p1, const void *p2)
+{
+	return strcmp(get_entity_ld_name(*(ir_entity* const*)p1), get_entity_ld_name(*(ir_entity* const*)p2));
 }
 
-static void walk_callgraph_and_devirtualize(ir_node *node, void* environment)
+/** replaces the calls of graph collected by optimizer_handle_dynamic_call by a cascade of direct calls to their targets and an indirect call as fallback
+ * @note The vtable slot (or interface lookup result) is compared with each target instead of the vptr with each live class, because a target is usually shared by several live classes. The order of the targets doesn't matter for correctness; without profile data they are ordered by linker name to keep the output deterministic.
+ */
+static void optimizer_lower_type_switches(ir_graph *graph, optimizer_env *env)
 {
-	assert(environment);
-	optimizer_env *env = (optimizer_env*)environment;
+	if (pdeq_empty(env->type_switch_calls))
+		return;
 
-	switch (get_irn_opcode(node)) {
-	case iro_Call: {
-		ir_node *call = node;
-		ir_node *callee = get_irn_n(call, 1);
-		if (is_Address(callee)) {
-			// static call
-			ir_entity *entity = get_Address_entity(callee);
+	ir_reserve_resources(graph, IR_RESOURCE_IRN_LINK | IR_RESOURCE_PHI_LIST);
+	collect_phiprojs_and_start_block_nodes(graph);
 
-			optimizer_handle_static_call(call, entity, env);
+	while (!pdeq_empty(env->type_switch_calls)) {
+		ir_node *call = pdeq_getl(env->type_switch_calls);
+		ir_entity *entity = get_MethodSel_entity(get_Proj_pred(get_Call_ptr(call)));
+		cpset_t *targets = cpmap_find(env->dyncall_targets, entity);
+		assert(targets);
 
-		} else if (is_Proj(callee)) {
-			ir_node *pred = get_Proj_pred(callee);
-			if (is_MethodSel(pred)) {
-				ir_node *methodsel = pred;
-				ir_entity *entity = get_MethodSel_entity(methodsel);
+		size_t n_targets = cpset_size(targets);
+		ir_entity **sorted = XMALLOCN(ir_entity*, n_targets);
+		cpset_iterator_t it;
+		cpset_iterator_init(&it, targets);
+		for (size_t i = 0; i < n_targets; i++)
+			sorted[i] = cpset_iterator_next(&it);
+		qsort(sorted, n_targets, sizeof(*sorted), cmp_entity_ld_name);
 
-				if (oo_get_call_is_statically_bound(call)) {
-					// weird case of Call with MethodSel that is marked statically bound
-					optimizer_handle_static_call(call, entity, env);
-				} else {
-					// dynamic call
-					optimizer_handle_dynamic_call(call, entity, methodsel, env);
-				}
-			} else {
-				// indirect call via function pointers or are there even more types of calls?
-				DEBUGOUT("\tcall: neither Address nor Proj of MethodSel as callee: %s", gdb_node_helper(call));
-				DEBUGOUT("-> %s", gdb_node_helper(callee));
-				DEBUGOUT("-> %s\n", gdb_node_helper(pred));
-				#ifdef RTA_STATS
-						env->n_others++;
-				#endif
-			}
-		} else {
-			// indirect call via function pointers or are there even more types of calls?
-			DEBUGOUT("\tcall: neither Address nor Proj of MethodSel as callee: %s", gdb_node_helper(call));
-			DEBUGOUT("-> %s\n", gdb_node_helper(callee));
-			#ifdef RTA_STATS
-					env->n_others++;
-			#endif
-		}
-		break;
-	}
-	default:
-		// skip other node types
-		break;
+		ddispatch_split_call(call, n_targets, sorted);
+		free(sorted);
+
+#ifdef RTA_STATS
+		env->n_type_switches++;
+#endif
 	}
 
+	ir_free_resources(graph, IR_RESOURCE_IRN_LINK | IR_RESOURCE_PHI_LIST);
+	confirm_irg_properties(graph, IR_GRAPH_PROPERTIES_NONE);
 }
 
-/** devirtualizes dyncalls if their target set contains only one entry
- * @param entry_points same as used with rta_run
+/** devirtualizes dyncalls if their target set contains only one entry and splits them into a type-switch if it contains at most type_switch_limit entries
+ * @param dyncalls the dynamically bound Call nodes recorded by rta_run, grouped by graph
  * @param dyncall_targets the result map returned from rta_run
  */
-static void rta_devirtualize_calls(ir_entity **entry_points, cpmap_t *dyncall_targets)
+static void rta_devirtualize_calls(pdeq *dyncalls, cpmap_t *dyncall_targets)
 {
+	assert(dyncalls);
 	assert(dyncall_targets);
 
-	pdeq *workqueue = new_pdeq();
-
-	cpset_t done_set;
-	cpset_init(&done_set, hash_ptr, ptr_equals);
-
 	optimizer_env env = {
-		.workqueue = workqueue,
-		.done_set = &done_set,
 		.dyncall_targets = dyncall_targets,
+		.type_switch_calls = new_pdeq(),
 #ifdef RTA_STATS
-		.n_staticcalls = 0,
 		.n_dyncalls = 0,
 		.n_icalls = 0,
 		.n_devirts = 0,
 		.n_devirts_icalls = 0,
-		.n_others = 0,
+		.n_type_switches = 0,
 #endif
 	};
 
-	{ // add all given entry points to workqueue
-		ir_entity *entity;
-		for (size_t i=0; (entity = entry_points[i]) != NULL; i++) {
-			assert(is_method_entity(entity));
-			ir_graph *graph = get_entity_irg(entity);
-			assert(graph); // don't give methods without a graph as entry points for the analysis
-			// add to workqueue
-			pdeq_putr(workqueue, entity);
+	ir_graph *graph = NULL;
+	while (!pdeq_empty(dyncalls)) {
+		ir_node *call = pdeq_getl(dyncalls);
+		assert(is_Call(call));
+
+		if (get_irn_irg(call) != graph) {
+			if (graph != NULL)
+				optimizer_lower_type_switches(graph, &env);
+			graph = get_irn_irg(call);
+			DEBUGOUT("\n== %s\n", get_entity_ld_name(get_irg_entity(graph)));
 		}
+
+		// the MethodSel could be shared with a call that was already devirtualized
+		ir_node *callee = get_irn_n(call, 1);
+		if (!is_Proj(callee) || !is_MethodSel(get_Proj_pred(callee))) continue;
+		ir_node *methodsel = get_Proj_pred(callee);
+		optimizer_handle_dynamic_call(call, get_MethodSel_entity(methodsel), methodsel, &env);
 	}
+	if (graph != NULL)
+		optimizer_lower_type_switches(graph, &env);
 
-	while (!pdeq_empty(workqueue)) {
-		ir_entity *entity = pdeq_getl(workqueue);
-		assert(entity && is_method_entity(entity));
+#ifdef RTA_STATS
+	printf("dynamic calls: %llu\n", env.n_dyncalls);
+	printf("interface calls: %llu\n", env.n_icalls);
+	printf("devirtualizations of dynamic calls: %llu\n", env.n_devirts);
+	printf("devirtualizations of interface calls: %llu\n", env.n_devirts_icalls);
+	printf("type-switches: %llu\n", env.n_type_switches);
+#endif
 
-		if (cpset_find(&done_set, entity) != NULL) continue;
+	// free data structures
+	del_pdeq(env.type_switch_calls);
+}
 
-		DEBUGOUT("\n== %s.%s (%s)\n", get_compound_name(get_entity_owner(entity)), get_entity_name(entity), get_entity_ld_name(entity));
 
-		cpset_insert(&done_set, entity); // mark as done _before_ walking to not add it again in case of recursive calls
-		ir_graph *graph = get_entity_irg(entity);
-		if (graph == NULL) {
-			optimizer_handle_no_graph(entity, &env);
-		} else {
-			irg_walk_graph(graph, NULL, walk_callgraph_and_devirtualize, &env);
+typedef struct discard_env {
+	cpset_t *live_classes; // live classes as returned by rta_run
+	cpset_t *live_methods; // live methods as returned by rta_run
+	cpset_t used_types; // classes and interfaces whose vtable and runtime type information is still needed
+	cpset_t referenced; // entities whose address is taken in kept code or static data
+	cpmap_t metadata; // maps the vtable, itt and rtti entities of all classes to their class, they are kept or discarded together with it
+	pdeq *workqueue; // kept graphs that still have to be scanned for references
+#ifdef RTA_STATS
+	unsigned long long n_dead_classes; // number of classes without vtable and rtti
+	unsigned long long n_dead_methods; // number of methods whose graph was removed
+#endif
+} discard_env;
+
+static bool is_discardable_method(ir_entity *method, discard_env *env)
+{
+	ir_type *owner = get_entity_owner(method);
+	return is_Class_type(owner) && owner != get_glob_type() && !oo_get_class_is_extern(owner)
+	    && get_entity_irg(method) != NULL && cpset_find(env->live_methods, method) == NULL;
+}
+
+static void discard_mark_used_type(ir_type *klass, discard_env *env); // forward declaration
+
+static void discard_mark_referenced(ir_entity *entity, discard_env *env)
+{
+	if (cpset_find(&env->referenced, entity) != NULL)
+		return;
+	cpset_insert(&env->referenced, entity);
+
+	// e.g. the class object of X.class, its class has to keep its metadata
+	ir_type *klass = cpmap_find(&env->metadata, entity);
+	if (klass != NULL)
+		discard_mark_used_type(klass, env);
+
+	// a graph that is kept only because its address is taken still has to be scanned
+	if (is_method_entity(entity) && is_discardable_method(entity, env))
+		pdeq_putr(env->workqueue, get_entity_irg(entity));
+}
+
+static void discard_scan_node(ir_node *node, discard_env *env)
+{
+	if (is_Address(node)) {
+		discard_mark_referenced(get_Address_entity(node), env);
+		return;
+	}
+	for (int i = 0, n = get_irn_arity(node); i < n; i++)
+		discard_scan_node(get_irn_n(node, i), env);
+}
+
+static void discard_scan_initializer(ir_initializer_t *initializer, discard_env *env)
+{
+	switch (get_initializer_kind(initializer)) {
+	case IR_INITIALIZER_CONST:
+		discard_scan_node(get_initializer_const_value(initializer), env);
+		return;
+	case IR_INITIALIZER_COMPOUND:
+		for (size_t i = 0, n = get_initializer_compound_n_entries(initializer); i < n; i++)
+			discard_scan_initializer(get_initializer_compound_value(initializer, i), env);
+		return;
+	case IR_INITIALIZER_TARVAL:
+	case IR_INITIALIZER_NULL:
+		return;
+	}
+}
+
+static void discard_scan_metadata(ir_entity *entity, discard_env *env)
+{
+	if (entity == NULL)
+		return;
+	// e.g. vtables that were already set up by the frontend
+	ir_initializer_t *initializer = get_entity_initializer(entity);
+	if (initializer != NULL)
+		discard_scan_initializer(initializer, env);
+}
+
+static void discard_mark_used_type(ir_type *klass, discard_env *env)
+{
+	assert(is_Class_type(klass));
+	if (klass == get_glob_type() || cpset_find(&env->used_types, klass) != NULL)
+		return;
+	cpset_insert(&env->used_types, klass);
+
+	discard_scan_metadata(oo_get_class_vtable_entity(klass), env);
+	discard_scan_metadata(oo_get_class_rtti_entity(klass), env);
+
+	// the vtable and rtti of a class refer to those of its supertypes
+	for (size_t i = 0, n = get_class_n_supertypes(klass); i < n; i++)
+		discard_mark_used_type(get_class_supertype(klass, i), env);
+}
+
+static void discard_walk_graph(ir_node *node, void *environment)
+{
+	discard_env *env = (discard_env*)environment;
+
+	if (is_Address(node)) {
+		discard_mark_referenced(get_Address_entity(node), env);
+	} else if (is_MethodSel(node)) {
+		// dispatch needs the vtable layout of the static type
+		discard_mark_used_type(get_entity_owner(get_MethodSel_entity(node)), env);
+	} else if (is_InstanceOf(node)) {
+		discard_mark_used_type(get_InstanceOf_type(node), env);
+	} else if (is_VptrIsSet(node)) {
+		discard_mark_used_type(get_VptrIsSet_type(node), env);
+	}
+}
+
+static void discard_collect_metadata(ir_type *klass, void *environment)
+{
+	discard_env *env = (discard_env*)environment;
+	if (klass == get_glob_type())
+		return;
+
+	ir_entity *metadata[] = { oo_get_class_vtable_entity(klass), oo_get_class_itt_entity(klass), oo_get_class_rtti_entity(klass) };
+	for (size_t i = 0; i < ARRAY_SIZE(metadata); i++) {
+		if (metadata[i] != NULL)
+			cpmap_set(&env->metadata, metadata[i], klass);
+	}
+}
+
+static void discard_scan_static_data(ir_type *klass, void *environment)
+{
+	discard_env *env = (discard_env*)environment;
+
+	for (size_t i = 0, n = get_class_n_members(klass); i < n; i++) {
+		ir_entity *member = get_class_member(klass, i);
+		if (get_entity_kind(member) != IR_ENTITY_NORMAL || cpmap_find(&env->metadata, member) != NULL)
+			continue;
+		ir_initializer_t *initializer = get_entity_initializer(member);
+		if (initializer != NULL)
+			discard_scan_initializer(initializer, env);
+	}
+}
+
+static void discard_class(ir_type *klass, void *environment)
+{
+	discard_env *env = (discard_env*)environment;
+	if (klass == get_glob_type() || oo_get_class_is_extern(klass) || cpset_find(&env->used_types, klass) != NULL)
+		return;
+
+	DEBUGOUT("\tdiscarding class %s\n", get_compound_name(klass));
+	// without vtable entity there is no vtable, itable and ITT, without rtti entity no rtti (see ddispatch_setup_vtable etc.)
+	ir_entity *metadata[] = { oo_get_class_vtable_entity(klass), oo_get_class_itt_entity(klass), oo_get_class_rtti_entity(klass) };
+	oo_set_class_vtable_entity(klass, NULL);
+	oo_set_class_itt_entity(klass, NULL);
+	oo_set_class_rtti_entity(klass, NULL);
+
+	// any reference from kept code or static data would have marked the class as used, so the entities can go
+	for (size_t i = 0; i < ARRAY_SIZE(metadata); i++) {
+		if (metadata[i] != NULL)
+			free_entity(metadata[i]);
+	}
+
+#ifdef RTA_STATS
+	env->n_dead_classes++;
+#endif
+}
+
+static void discard_inherited_copies(ir_entity *method)
+{
+	for (size_t i = 0, n = get_entity_n_overwrittenby(method); i < n; i++) {
+		ir_entity *overwriting = get_entity_overwrittenby(method, i);
+		if (!oo_get_method_is_inherited(overwriting))
+			continue;
+		oo_set_method_is_abstract(overwriting, true);
+		discard_inherited_copies(overwriting);
+	}
+}
+
+static void discard_method(ir_entity *method, discard_env *env)
+{
+	(void)env;
+	DEBUGOUT("\tdiscarding method %s.%s\n", get_compound_name(get_entity_owner(method)), get_entity_name(method));
+	// also removes the graph from the program and clears the entity's irg,
+	// which is only declared from now on
+	free_ir_graph(get_entity_irg(method));
+	set_entity_visibility(method, ir_visibility_external);
+
+	// vtable and itable slots get the abstract method error instead
+	oo_set_method_is_abstract(method, true);
+	discard_inherited_copies(method);
+
+#ifdef RTA_STATS
+	env->n_dead_methods++;
+#endif
+}
+
+/** discards the classes and methods found to be unused
+ * Classes that are neither live nor needed by kept code (for dispatch, type tests or by taking the address of their vtable, itt or rtti) lose these entities, so no vtable, itable, ITT or rtti is emitted for them. Graphs of methods that were not reached and whose address is not taken are freed, leaving a mere declaration, their vtable slots in live classes are filled with the abstract method error.
+ * @note Has to run before oo_lower. The frontend's runtime typeinfo constructor has to skip classes without rtti entity, just like rtti_default_construct_runtime_typeinfo.
+ * @param live_classes as returned by rta_run
+ * @param live_methods as returned by rta_run
+ */
+static void rta_discard(cpset_t *live_classes, cpset_t *live_methods)
+{
+	assert(live_classes);
+	assert(live_methods);
+
+	discard_env env = {
+		.live_classes = live_classes,
+		.live_methods = live_methods,
+		.workqueue = new_pdeq(),
+#ifdef RTA_STATS
+		.n_dead_classes = 0,
+		.n_dead_methods = 0,
+#endif
+	};
+	cpset_init(&env.used_types, hash_ptr, ptr_equals);
+	cpset_init(&env.referenced, hash_ptr, ptr_equals);
+	cpmap_init(&env.metadata, hash_ptr, ptr_equals);
+
+	class_walk_super2sub(discard_collect_metadata, NULL, &env);
+
+	{ // live classes are instantiated, extern classes are defined elsewhere
+		cpset_iterator_t it;
+		cpset_iterator_init(&it, live_classes);
+		ir_type *klass;
+		while ((klass = cpset_iterator_next(&it)) != NULL)
+			discard_mark_used_type(klass, &env);
+	}
+
+	// every graph that isn't discarded right away and all static data may refer to other entities
+	for (size_t i = 0, n = get_irp_n_irgs(); i < n; i++) {
+		ir_graph *graph = get_irp_irg(i);
+		if (!is_discardable_method(get_irg_entity(graph), &env))
+			pdeq_putr(env.workqueue, graph);
+	}
+	class_walk_super2sub(discard_scan_static_data, NULL, &env);
+
+	while (!pdeq_empty(env.workqueue)) {
+		ir_graph *graph = pdeq_getl(env.workqueue);
+		irg_walk_graph(graph, NULL, discard_walk_graph, &env);
+	}
+
+	class_walk_super2sub(discard_class, NULL, &env);
+
+	{ // collect first, removing graphs changes the irg list
+		pdeq *dead_methods = new_pdeq();
+		for (size_t i = 0, n = get_irp_n_irgs(); i < n; i++) {
+			ir_entity *method = get_irg_entity(get_irp_irg(i));
+			if (is_discardable_method(method, &env) && cpset_find(&env.referenced, method) == NULL)
+				pdeq_putr(dead_methods, method);
 		}
+		while (!pdeq_empty(dead_methods))
+			discard_method(pdeq_getl(dead_methods), &env);
+		del_pdeq(dead_methods);
 	}
 
 #ifdef RTA_STATS
-	printf("static calls: %llu\n", env.n_staticcalls);
-	printf("dynamic calls: %llu\n", env.n_dyncalls);
-	printf("interface calls: %llu\n", env.n_icalls);
-	printf("devirtualizations of dynamic calls: %llu\n", env.n_devirts);
-	printf("devirtualizations of interface calls: %llu\n", env.n_devirts_icalls);
-	printf("other calls: %llu\n", env.n_others);
+	printf("discarded classes: %llu\n", env.n_dead_classes);
+	printf("discarded methods: %llu\n", env.n_dead_methods);
 #endif
 
 	// free data structures
-	del_pdeq(workqueue);
-	cpset_destroy(&done_set);
+	del_pdeq(env.workqueue);
+	cpset_destroy(&env.used_types);
+	cpset_destroy(&env.referenced);
+	cpmap_destroy(&env.metadata);
 }
 
 
@@ -1063,8 +1768,17 @@ void rta_optimization(ir_entity **entry_points, ir_type **initial_live_classes)
 	cpset_t live_methods;
 	cpmap_t dyncall_targets;
 
-	rta_run(entry_points, initial_live_classes, &live_classes, &live_methods, &dyncall_targets);
-	rta_devirtualize_calls(entry_points, &dyncall_targets);
-	//rta_discard(&live_classes, &live_methods); //TODO
+	number_classes_and_methods();
+
+	pdeq *dyncalls = new_pdeq();
+
+	if (per_method_type_sets)
+		xta_run(entry_points, initial_live_classes, &live_classes, &live_methods, &dyncall_targets, dyncalls);
+	else
+		rta_run(entry_points, initial_live_classes, &live_classes, &live_methods, &dyncall_targets, dyncalls);
+	rta_devirtualize_calls(dyncalls, &dyncall_targets);
+	del_pdeq(dyncalls);
+	rta_discard(&live_classes, &live_methods);
 	rta_dispose_results(&live_classes, &live_methods, &dyncall_targets);
+	free_class_and_method_ids();
 }
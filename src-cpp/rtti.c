@@ -2,13 +2,17 @@
 #include "liboo/oo.h"
 #include "liboo/rts_types.h"
 #include "liboo/nodes.h"
+#include "table_pool.h"
 
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
 #include "adt/error.h"
 #include "adt/cpset.h"
+#include "adt/cpmap.h"
+#include "adt/hashptr.h"
 #include "adt/obst.h"
+#include "adt/pdeq.h"
 #include "adt/util.h"
 
 static ir_type   *class_info;
@@ -20,6 +24,17 @@ static ir_entity *class_info_n_methods;
 static ir_entity *class_info_methods;
 static ir_entity *class_info_n_interfaces;
 static ir_entity *class_info_interfaces;
+static ir_entity *class_info_depth;
+static ir_entity *class_info_display;
+static ir_entity *class_info_preorder_uid;
+static ir_entity *class_info_max_subclass_uid;
+static ir_entity *class_info_preorder_numbering;
+static ir_entity *class_info_interface_index;
+static ir_entity *class_info_n_interface_words;
+static ir_entity *class_info_interface_bits;
+static ir_entity *class_info_interface_numbering;
+static ir_entity *class_info_method_index_size;
+static ir_entity *class_info_method_index;
 
 static ir_type   *method_info;
 static ir_entity *method_info_name;
@@ -27,6 +42,7 @@ static ir_entity *method_info_funcptr;
 
 static ir_type   *method_info_array;
 static ir_type   *reference_array;
+static ir_type   *uint32_array;
 
 static ir_type   *string_const;
 static ir_entity *string_const_hash;
@@ -36,6 +52,19 @@ static ir_entity *default_instanceof_entity;
 static ir_entity *default_abstract_method_error_entity;
 
 static cpset_t string_constant_pool;
+static table_pool_t method_table_pool;
+
+/* dense numbering of all interfaces for the interface bitsets, the map
+ * stores index+1 */
+static cpmap_t   interface_index_map;
+static unsigned  n_interface_indices;
+static ir_entity *empty_interface_bits;
+/* private to this compilation unit, its address tells the runtime which
+ * classes got their interface indices and preorder uids together */
+static ir_entity *unit_numbering;
+
+/* InstanceOf nodes waiting for rtti_lower_deferred_instanceofs */
+static pdeq      *deferred_instanceofs;
 
 typedef struct {
 	char      *string;
@@ -54,6 +83,11 @@ static void free_scpe(scp_entry_t *scpe)
 	free(scpe);
 }
 
+static int ptr_equals(const void *p1, const void *p2)
+{
+	return p1 == p2;
+}
+
 static int scp_cmp_function(const void *p1, const void *p2)
 {
 	scp_entry_t *scpe1 = (scp_entry_t*) p1;
@@ -116,6 +150,30 @@ static void init_rtti_firm_types(void)
 	class_info_n_interfaces = new_entity(class_info, id, type_uint32_t);
 	id = new_id_from_str("interfaces");
 	class_info_interfaces = new_entity(class_info, id, type_reference);
+	id = new_id_from_str("depth");
+	class_info_depth = new_entity(class_info, id, type_uint32_t);
+	ir_type *type_display = new_type_array(type_reference, OO_CLASS_DISPLAY_SIZE);
+	set_type_state(type_display, layout_fixed);
+	id = new_id_from_str("display");
+	class_info_display = new_entity(class_info, id, type_display);
+	id = new_id_from_str("preorder_uid");
+	class_info_preorder_uid = new_entity(class_info, id, type_uint32_t);
+	id = new_id_from_str("max_subclass_uid");
+	class_info_max_subclass_uid = new_entity(class_info, id, type_uint32_t);
+	id = new_id_from_str("preorder_numbering");
+	class_info_preorder_numbering = new_entity(class_info, id, type_reference);
+	id = new_id_from_str("interface_index");
+	class_info_interface_index = new_entity(class_info, id, type_uint32_t);
+	id = new_id_from_str("n_interface_words");
+	class_info_n_interface_words = new_entity(class_info, id, type_uint32_t);
+	id = new_id_from_str("interface_bits");
+	class_info_interface_bits = new_entity(class_info, id, type_reference);
+	id = new_id_from_str("interface_numbering");
+	class_info_interface_numbering = new_entity(class_info, id, type_reference);
+	id = new_id_from_str("method_index_size");
+	class_info_method_index_size = new_entity(class_info, id, type_uint32_t);
+	id = new_id_from_str("method_index");
+	class_info_method_index = new_entity(class_info, id, type_reference);
 	default_layout_compound_type(class_info);
 	/* I'd really like to use the following assert, unfortunately it is
 	 * useless when we are cross-compiling. And I see no easy way at the
@@ -145,6 +203,7 @@ static void init_rtti_firm_types(void)
 	/* assert(get_type_size(string_const) == sizeof(string_const_t)); */
 
 	reference_array = new_type_array(type_reference, 0);
+	uint32_array    = new_type_array(type_uint32_t, 0);
 
 	ir_type *default_io_type = new_type_method(2, 1, false, cc_cdecl_set, mtp_no_property);
 	set_method_param_type(default_io_type, 0, type_reference);
@@ -223,7 +282,7 @@ static ir_initializer_t *create_method_info(ir_entity *method)
 	if (oo_get_method_is_abstract(method)) {
 		method_init = new_initializer_reference(default_abstract_method_error_entity);
 	} else {
-		method_init = new_initializer_reference(method);
+		method_init = new_initializer_reference(oo_get_method_implementation(method));
 	}
 	set_initializer_compound_value(initializer, i++, method_init);
 	assert(i == n_members);
@@ -231,10 +290,17 @@ static ir_initializer_t *create_method_info(ir_entity *method)
 	return initializer;
 }
 
+/**
+ * Method tables are shared between classes whose tables would reference
+ * the same (name, funcptr) pairs, see table_pool_t. Inherited methods
+ * reference the implementation in the superclass, so a subclass that
+ * overrides nothing shares the table of its superclass.
+ */
 static ir_entity *create_method_table(ir_type *klass, size_t n_methods)
 {
-	ir_initializer_t *initializer = create_initializer_compound(n_methods);
-	size_t            i           = 0;
+	ir_entity **methods  = XMALLOCN(ir_entity*, n_methods);
+	ident     **contents = XMALLOCN(ident*, 2 * n_methods);
+	size_t      i        = 0;
 
 	size_t n_members = get_compound_n_members(klass);
 	for (size_t m = 0; m < n_members; ++m) {
@@ -244,18 +310,111 @@ static ir_entity *create_method_table(ir_type *klass, size_t n_methods)
 		if (oo_get_method_exclude_from_vtable(member))
 			continue;
 
-		ir_initializer_t *mt_init = create_method_info(member);
-		set_initializer_compound_value(initializer, i++, mt_init);
+		ir_entity *name = rtti_emit_string_const(get_entity_name(member));
+		ir_entity *impl = oo_get_method_is_abstract(member)
+		                ? default_abstract_method_error_entity
+		                : oo_get_method_implementation(member);
+		contents[2 * i]     = get_entity_ld_ident(name);
+		contents[2 * i + 1] = get_entity_ld_ident(impl);
+		methods[i++]        = member;
 	}
 	assert(i == n_methods);
 
-	ident     *id     = id_unique("rtti_mt_");
+	ir_entity *entity = table_pool_find(&method_table_pool, contents, 2 * n_methods);
+	if (entity == NULL) {
+		ir_initializer_t *initializer = create_initializer_compound(n_methods);
+		for (i = 0; i < n_methods; ++i) {
+			ir_initializer_t *mt_init = create_method_info(methods[i]);
+			set_initializer_compound_value(initializer, i, mt_init);
+		}
+
+		ident   *id   = id_unique("rtti_mt_");
+		ir_type *glob = get_glob_type();
+		entity = new_entity(glob, id, method_info_array);
+		set_entity_visibility(entity, ir_visibility_private);
+		set_entity_linkage(entity, IR_LINKAGE_CONSTANT);
+		set_entity_initializer(entity, initializer);
+
+		table_pool_insert(&method_table_pool, contents, 2 * n_methods, entity);
+	}
+
+	free(contents);
+	free(methods);
+
+	return entity;
+}
+
+/**
+ * Creates an open addressed hash table over the names of all methods of
+ * @p klass and its superclasses (overriding methods hide the overwritten
+ * ones), so the runtime interface lookup needs a single probe sequence.
+ */
+static ir_entity *create_method_index(ir_type *klass, uint32_t *size)
+{
+	size_t n_candidates = 0;
+	for (ir_type *k = klass; k != NULL; k = oo_get_class_superclass(k)) {
+		n_candidates += get_class_n_members(k);
+	}
+
+	ir_entity **methods   = XMALLOCN(ir_entity*, n_candidates);
+	size_t      n_methods = 0;
+	cpset_t     names;
+	cpset_init(&names, hash_ptr, ptr_equals);
+	for (ir_type *k = klass; k != NULL; k = oo_get_class_superclass(k)) {
+		size_t n_members = get_class_n_members(k);
+		for (size_t m = 0; m < n_members; ++m) {
+			ir_entity *member = get_class_member(k, m);
+			if (!is_method_entity(member))
+				continue;
+			if (oo_get_method_exclude_from_vtable(member))
+				continue;
+			ident *name = get_entity_ident(member);
+			if (cpset_find(&names, name) != NULL)
+				continue;
+			cpset_insert(&names, name);
+			methods[n_methods++] = member;
+		}
+	}
+	cpset_destroy(&names);
+
+	if (n_methods == 0) {
+		free(methods);
+		*size = 0;
+		return NULL;
+	}
+
+	/* keep the load factor at or below 1/2 */
+	uint32_t n_slots = 2;
+	while (n_slots < 2 * n_methods)
+		n_slots *= 2;
+
+	ir_entity **slots = XMALLOCNZ(ir_entity*, n_slots);
+	for (size_t m = 0; m < n_methods; ++m) {
+		uint32_t hash = string_hash(get_entity_name(methods[m]));
+		uint32_t i    = hash & (n_slots - 1);
+		while (slots[i] != NULL)
+			i = (i + 1) & (n_slots - 1);
+		slots[i] = methods[m];
+	}
+	free(methods);
+
+	ir_initializer_t *initializer = create_initializer_compound(n_slots);
+	for (uint32_t i = 0; i < n_slots; ++i) {
+		ir_initializer_t *slot_init = slots[i] != NULL
+		                            ? create_method_info(slots[i])
+		                            : get_initializer_null();
+		set_initializer_compound_value(initializer, i, slot_init);
+	}
+	free(slots);
+
+	ident     *id     = id_unique("rtti_mi_");
 	ir_type   *glob   = get_glob_type();
 	ir_entity *entity = new_entity(glob, id, method_info_array);
 	set_entity_visibility(entity, ir_visibility_private);
 	set_entity_linkage(entity, IR_LINKAGE_CONSTANT);
 	set_entity_initializer(entity, initializer);
 
+	*size = n_slots;
 	return entity;
 }
 
@@ -286,6 +445,150 @@ static ir_entity *create_interface_table(ir_type *klass, size_t n_interfaces)
 	return entity;
 }
 
+/**
+ * Returns the dense index of @p iface used in the interface bitsets. Indices
+ * are assigned on first use.
+ */
+static uint32_t get_interface_index(ir_type *iface)
+{
+	assert(oo_get_class_is_interface(iface));
+	void *entry = cpmap_find(&interface_index_map, iface);
+	if (entry != NULL)
+		return PTR_TO_INT(entry) - 1;
+
+	uint32_t index = n_interface_indices++;
+	cpmap_set(&interface_index_map, iface, INT_TO_PTR(index + 1));
+	return index;
+}
+
+static ir_entity *get_unit_numbering(void)
+{
+	if (unit_numbering == NULL) {
+		ir_type *type_uint32_t = get_array_element_type(uint32_array);
+		unit_numbering = new_entity(get_glob_type(), id_unique("rtti_unit_numbering_"), type_uint32_t);
+		set_entity_visibility(unit_numbering, ir_visibility_private);
+		set_entity_initializer(unit_numbering, get_initializer_null());
+	}
+	return unit_numbering;
+}
+
+static void collect_interfaces(ir_type *klass, cpset_t *interfaces)
+{
+	if (oo_get_class_is_interface(klass))
+		cpset_insert(interfaces, klass);
+
+	size_t n_supertypes = get_class_n_supertypes(klass);
+	for (size_t s = 0; s < n_supertypes; ++s) {
+		ir_type *supertype = get_class_supertype(klass, s);
+		if (cpset_find(interfaces, supertype) != NULL)
+			continue;
+		collect_interfaces(supertype, interfaces);
+	}
+}
+
+static ir_entity *create_uint32_table(const char *prefix, const uint32_t *values, size_t n_values)
+{
+	ir_type          *type_uint32_t = get_array_element_type(uint32_array);
+	ir_initializer_t *initializer   = create_initializer_compound(n_values);
+	for (size_t i = 0; i < n_values; ++i) {
+		ir_initializer_t *value_init = new_initializer_long(values[i], type_uint32_t);
+		set_initializer_compound_value(initializer, i, value_init);
+	}
+
+	ident     *id     = id_unique(prefix);
+	ir_type   *glob   = get_glob_type();
+	ir_entity *entity = new_entity(glob, id, uint32_array);
+	set_entity_visibility(entity, ir_visibility_private);
+	set_entity_linkage(entity, IR_LINKAGE_CONSTANT);
+	set_entity_initializer(entity, initializer);
+
+	return entity;
+}
+
+/**
+ * Creates the bitset of all interfaces (transitively) implemented by
+ * @p klass. Classes without interfaces share a single zero word, so the
+ * bitset pointer is always valid to dereference.
+ */
+static ir_entity *create_interface_bits(ir_type *klass, uint32_t *n_words)
+{
+	cpset_t interfaces;
+	cpset_init(&interfaces, hash_ptr, ptr_equals);
+	collect_interfaces(klass, &interfaces);
+
+	uint32_t n_bits = 0;
+	cpset_iterator_t iter;
+	cpset_iterator_init(&iter, &interfaces);
+	ir_type *iface;
+	while ((iface = cpset_iterator_next(&iter)) != NULL) {
+		n_bits = MAX(n_bits, get_interface_index(iface) + 1);
+	}
+
+	ir_entity *entity;
+	if (n_bits == 0) {
+		if (empty_interface_bits == NULL) {
+			uint32_t zero = 0;
+			empty_interface_bits = create_uint32_table("rtti_ib_", &zero, 1);
+		}
+		*n_words = 0;
+		entity   = empty_interface_bits;
+	} else {
+		*n_words = (n_bits + 31) / 32;
+		uint32_t *words = XMALLOCNZ(uint32_t, *n_words);
+		cpset_iterator_init(&iter, &interfaces);
+		while ((iface = cpset_iterator_next(&iter)) != NULL) {
+			uint32_t index = get_interface_index(iface);
+			words[index / 32] |= 1u << (index % 32);
+		}
+		entity = create_uint32_table("rtti_ib_", words, *n_words);
+		free(words);
+	}
+
+	cpset_destroy(&interfaces);
+	return entity;
+}
+
+/**
+ * Returns the number of superclasses of @p klass or OO_CLASS_DEPTH_INTERFACE
+ * for interfaces.
+ */
+static uint32_t get_class_depth(ir_type *klass)
+{
+	if (oo_get_class_is_interface(klass))
+		return OO_CLASS_DEPTH_INTERFACE;
+
+	uint32_t depth = 0;
+	for (ir_type *s = oo_get_class_superclass(klass); s != NULL;
+	     s = oo_get_class_superclass(s)) {
+		++depth;
+	}
+	return depth;
+}
+
+static ir_initializer_t *create_display(ir_type *klass, uint32_t depth)
+{
+	ir_initializer_t *initializer
+		= create_initializer_compound(OO_CLASS_DISPLAY_SIZE);
+	for (size_t i = 0; i < OO_CLASS_DISPLAY_SIZE; ++i) {
+		set_initializer_compound_value(initializer, i, get_initializer_null());
+	}
+	if (depth == OO_CLASS_DEPTH_INTERFACE)
+		return initializer;
+
+	/* fill in the superclass chain bottom-up, skipping the levels that
+	 * do not fit into the display */
+	uint32_t d = depth;
+	for (ir_type *k = klass; k != NULL; k = oo_get_class_superclass(k), --d) {
+		if (d >= OO_CLASS_DISPLAY_SIZE)
+			continue;
+		ir_entity *k_rtti = oo_get_class_rtti_entity(k);
+		assert(k_rtti != NULL);
+		set_initializer_compound_value(initializer, d,
+		                               new_initializer_reference(k_rtti));
+	}
+	return initializer;
+}
+
 void rtti_default_construct_runtime_typeinfo(ir_type *klass)
 {
 	assert(is_Class_type(klass));
@@ -377,6 +680,58 @@ void rtti_default_construct_runtime_typeinfo(ir_type *klass)
 	}
 	set_initializer_compound_value(initializer, i++, interfaces_init);
 
+	uint32_t          depth      = get_class_depth(klass);
+	ir_type          *depth_type = get_entity_type(class_info_depth);
+	ir_initializer_t *depth_init = new_initializer_long(depth, depth_type);
+	set_initializer_compound_value(initializer, i++, depth_init);
+
+	ir_initializer_t *display_init = create_display(klass, depth);
+	set_initializer_compound_value(initializer, i++, display_init);
+
+	uint32_t          preorder_uid = oo_get_class_preorder_uid(klass);
+	ir_type          *preorder_uid_type = get_entity_type(class_info_preorder_uid);
+	ir_initializer_t *preorder_uid_init = new_initializer_long(preorder_uid, preorder_uid_type);
+	set_initializer_compound_value(initializer, i++, preorder_uid_init);
+
+	uint32_t          max_uid      = oo_get_class_max_subclass_uid(klass);
+	ir_type          *max_uid_type = get_entity_type(class_info_max_subclass_uid);
+	ir_initializer_t *max_uid_init = new_initializer_long(max_uid, max_uid_type);
+	set_initializer_compound_value(initializer, i++, max_uid_init);
+	ir_initializer_t *preorder_numbering_init
+		= oo_get_class_preorder_numbering(klass) != 0
+		? new_initializer_reference(get_unit_numbering())
+		: get_initializer_null();
+	set_initializer_compound_value(initializer, i++, preorder_numbering_init);
+
+	uint32_t iface_index = oo_get_class_is_interface(klass)
+	                     ? get_interface_index(klass) : 0;
+	ir_type          *iface_index_type = get_entity_type(class_info_interface_index);
+	ir_initializer_t *iface_index_init = new_initializer_long(iface_index, iface_index_type);
+	set_initializer_compound_value(initializer, i++, iface_index_init);
+
+	uint32_t          n_words         = 0;
+	ir_entity        *iface_bits      = create_interface_bits(klass, &n_words);
+	ir_type          *n_words_type    = get_entity_type(class_info_n_interface_words);
+	ir_initializer_t *n_words_init    = new_initializer_long(n_words, n_words_type);
+	set_initializer_compound_value(initializer, i++, n_words_init);
+	ir_initializer_t *iface_bits_init = new_initializer_reference(iface_bits);
+	set_initializer_compound_value(initializer, i++, iface_bits_init);
+	ir_initializer_t *numbering_init  = new_initializer_reference(get_unit_numbering());
+	set_initializer_compound_value(initializer, i++, numbering_init);
+
+	/* interfaces are never the dynamic type of an object and need no index */
+	uint32_t   method_index_size = 0;
+	ir_entity *method_index      = NULL;
+	if (!oo_get_class_is_interface(klass))
+		method_index = create_method_index(klass, &method_index_size);
+	ir_type          *mi_size_type = get_entity_type(class_info_method_index_size);
+	ir_initializer_t *mi_size_init = new_initializer_long(method_index_size, mi_size_type);
+	set_initializer_compound_value(initializer, i++, mi_size_init);
+	ir_initializer_t *mi_init = method_index != NULL
+	                          ? new_initializer_reference(method_index)
+	                          : get_initializer_null();
+	set_initializer_compound_value(initializer, i++, mi_init);
+
 	assert(i == n_init);
 
 	set_entity_type(rtti_entity, class_info);
@@ -384,7 +739,7 @@ void rtti_default_construct_runtime_typeinfo(ir_type *klass)
 	add_entity_linkage(rtti_entity, IR_LINKAGE_CONSTANT);
 }
 
-ir_node *rtti_default_construct_instanceof(ir_node *objptr, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem)
+static ir_node *load_object_class_info(ir_node *objptr, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem)
 {
 	ir_type    *type_reference = get_type_for_mode(mode_P);
 	ir_node    *cur_mem      = *mem;
@@ -407,6 +762,15 @@ ir_node *rtti_default_construct_instanceof(ir_node *objptr, ir_type *klass, ir_g
 	ir_node    *obj_ci_ref   = new_r_Proj(obj_ci_load, mode_P, pn_Load_res);
 	            cur_mem      = new_r_Proj(obj_ci_load, mode_M, pn_Load_M);
 
+	*mem = cur_mem;
+
+	return obj_ci_ref;
+}
+
+static ir_node *call_runtime_instanceof(ir_node *obj_ci_ref, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem)
+{
+	ir_node    *cur_mem      = *mem;
+
 	// get a symconst to klass' classinfo.
 	ir_entity  *test_ci      = oo_get_class_rtti_entity(klass);
 	assert(test_ci);
@@ -426,6 +790,116 @@ ir_node *rtti_default_construct_instanceof(ir_node *objptr, ir_type *klass, ir_g
 	return res_b;
 }
 
+static ir_node *construct_interface_bit_test(ir_node *obj_ci_ref, ir_type *iface, ir_graph *irg, ir_node *block, ir_node **mem)
+{
+	ir_node   *cur_mem      = *mem;
+	uint32_t   index        = get_interface_index(iface);
+	ir_type   *type_uint32  = get_entity_type(class_info_n_interface_words);
+
+	ir_node   *n_words_addr = new_r_Member(block, obj_ci_ref, class_info_n_interface_words);
+	ir_node   *n_words_load = new_r_Load(block, cur_mem, n_words_addr, mode_Iu, type_uint32, cons_none);
+	ir_node   *n_words      = new_r_Proj(n_words_load, mode_Iu, pn_Load_res);
+	           cur_mem      = new_r_Proj(n_words_load, mode_M, pn_Load_M);
+
+	ir_type   *bits_type    = get_entity_type(class_info_interface_bits);
+	ir_node   *bits_addr    = new_r_Member(block, obj_ci_ref, class_info_interface_bits);
+	ir_node   *bits_load    = new_r_Load(block, cur_mem, bits_addr, mode_P, bits_type, cons_none);
+	ir_node   *bits         = new_r_Proj(bits_load, mode_P, pn_Load_res);
+	           cur_mem      = new_r_Proj(bits_load, mode_M, pn_Load_M);
+
+	// the bitset may be shorter than index, load the (always present)
+	// first word instead in that case and mask the result below
+	ir_node   *word_const   = new_r_Const_long(irg, mode_Iu, index / 32);
+	ir_node   *in_range     = new_r_Cmp(block, n_words, word_const, ir_relation_greater);
+	ir_mode   *mode_offset  = get_reference_offset_mode(mode_P);
+	ir_node   *word_offset  = new_r_Const_long(irg, mode_offset, (index / 32) * get_type_size(type_uint32));
+	ir_node   *word_add     = new_r_Add(block, bits, word_offset);
+	ir_node   *word_addr    = new_r_Mux(block, in_range, bits, word_add);
+	ir_node   *word_load    = new_r_Load(block, cur_mem, word_addr, mode_Iu, type_uint32, cons_none);
+	ir_node   *word         = new_r_Proj(word_load, mode_Iu, pn_Load_res);
+	           cur_mem      = new_r_Proj(word_load, mode_M, pn_Load_M);
+
+	ir_node   *mask         = new_r_Const_long(irg, mode_Iu, 1u << (index % 32));
+	ir_node   *bit          = new_r_And(block, word, mask);
+	ir_node   *bit_set      = new_r_Cmp(block, bit, new_r_Const_long(irg, mode_Iu, 0), ir_relation_less_greater);
+
+	*mem = cur_mem;
+
+	return new_r_And(block, in_range, bit_set);
+}
+
+static ir_node *construct_preorder_range_test(ir_node *obj_ci_ref, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem)
+{
+	// the subclasses of klass are numbered [uid, max_subclass_uid],
+	// so (obj_uid - uid) <= (max - uid) unsigned
+	unsigned   uid       = oo_get_class_preorder_uid(klass);
+	unsigned   max_uid   = oo_get_class_max_subclass_uid(klass);
+	ir_type   *uid_type  = get_entity_type(class_info_preorder_uid);
+	ir_mode   *uid_mode  = get_type_mode(uid_type);
+	ir_node   *uid_addr  = new_r_Member(block, obj_ci_ref, class_info_preorder_uid);
+	ir_node   *uid_load  = new_r_Load(block, *mem, uid_addr, uid_mode, uid_type, cons_none);
+	ir_node   *obj_uid   = new_r_Proj(uid_load, uid_mode, pn_Load_res);
+	*mem                 = new_r_Proj(uid_load, mode_M, pn_Load_M);
+	ir_node   *uid_const = new_r_Const_long(irg, uid_mode, uid);
+	ir_node   *uid_diff  = new_r_Sub(block, obj_uid, uid_const);
+	ir_node   *range     = new_r_Const_long(irg, uid_mode, max_uid - uid);
+	return new_r_Cmp(block, uid_diff, range, ir_relation_less_equal);
+}
+
+/**
+ * Whether the inline test against @p klass uses indices or uids the
+ * object's class only shares if this compilation unit numbered it.
+ */
+static bool needs_numbering_guard(ir_type *klass)
+{
+	uint32_t depth = get_class_depth(klass);
+	if (depth == OO_CLASS_DEPTH_INTERFACE)
+		return true;
+	// the display is exact, preorder uids only pay off for deeper classes
+	return !oo_get_class_is_final(klass) && depth >= OO_CLASS_DISPLAY_SIZE
+	    && oo_get_class_preorder_numbering(klass) != 0;
+}
+
+ir_node *rtti_default_construct_instanceof(ir_node *objptr, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem)
+{
+	ir_node *obj_ci_ref = load_object_class_info(objptr, klass, irg, block, mem);
+	return call_runtime_instanceof(obj_ci_ref, klass, irg, block, mem);
+}
+
+ir_node *rtti_inline_construct_instanceof(ir_node *objptr, ir_type *klass, ir_graph *irg, ir_node *block, ir_node **mem)
+{
+	ir_node  *obj_ci_ref = load_object_class_info(objptr, klass, irg, block, mem);
+
+	// whether the object was numbered by this compilation unit can only be
+	// checked with control flow, see rtti_lower_InstanceOf
+	if (needs_numbering_guard(klass))
+		return call_runtime_instanceof(obj_ci_ref, klass, irg, block, mem);
+
+	ir_entity *test_ci     = oo_get_class_rtti_entity(klass);
+	assert(test_ci);
+	ir_node   *test_ci_ref = new_r_Address(irg, test_ci);
+
+	// a final class has no subclasses, comparing the classinfo is enough
+	if (oo_get_class_is_final(klass))
+		return new_r_Cmp(block, obj_ci_ref, test_ci_ref, ir_relation_equal);
+
+	// classes too deep for the display need the runtime
+	uint32_t   depth          = get_class_depth(klass);
+	if (depth >= OO_CLASS_DISPLAY_SIZE)
+		return call_runtime_instanceof(obj_ci_ref, klass, irg, block, mem);
+
+	// klass has to be found at its depth in the object's display
+	ir_type   *type_reference = get_type_for_mode(mode_P);
+	int        offset         = get_entity_offset(class_info_display) + depth * get_type_size(type_reference);
+	ir_mode   *mode_offset    = get_reference_offset_mode(mode_P);
+	ir_node   *display_offset = new_r_Const_long(irg, mode_offset, offset);
+	ir_node   *display_add    = new_r_Add(block, obj_ci_ref, display_offset);
+	ir_node   *display_load   = new_r_Load(block, *mem, display_add, mode_P, type_reference, cons_none);
+	ir_node   *display_ref    = new_r_Proj(display_load, mode_P, pn_Load_res);
+	*mem                      = new_r_Proj(display_load, mode_M, pn_Load_M);
+	return new_r_Cmp(block, display_ref, test_ci_ref, ir_relation_equal);
+}
+
 void rtti_init()
 {
 	construct_runtime_typeinfo = rtti_default_construct_runtime_typeinfo;
@@ -433,6 +907,12 @@ void rtti_init()
 
 	init_rtti_firm_types();
 	cpset_init(&string_constant_pool, scp_hash_function, scp_cmp_function);
+	table_pool_init(&method_table_pool);
+	cpmap_init(&interface_index_map, hash_ptr, ptr_equals);
+	n_interface_indices  = 0;
+	empty_interface_bits = NULL;
+	unit_numbering       = NULL;
+	deferred_instanceofs = new_pdeq();
 }
 
 void rtti_deinit()
@@ -446,6 +926,9 @@ void rtti_deinit()
 	}
 
 	cpset_destroy(&string_constant_pool);
+	table_pool_destroy(&method_table_pool);
+	cpmap_destroy(&interface_index_map);
+	del_pdeq(deferred_instanceofs);
 }
 
 void rtti_construct_runtime_typeinfo(ir_type *klass)
@@ -460,6 +943,14 @@ void rtti_lower_InstanceOf(ir_node *instanceof)
 	ir_node  *block   = get_nodes_block(instanceof);
 	ir_graph *irg     = get_irn_irg(instanceof);
 	ir_node  *cur_mem = get_InstanceOf_mem(instanceof);
+
+	// needs control flow, see rtti_lower_deferred_instanceofs
+	if (construct_instanceof == rtti_inline_construct_instanceof
+	    && needs_numbering_guard(type) && block != get_irg_start_block(irg)) {
+		pdeq_putr(deferred_instanceofs, instanceof);
+		return;
+	}
+
 	ir_node  *res     = construct_instanceof(objptr, type, irg, block, &cur_mem);
 
 	ir_node *in[pn_InstanceOf_max+1] = {
@@ -469,6 +960,83 @@ void rtti_lower_InstanceOf(ir_node *instanceof)
 	turn_into_tuple(instanceof, ARRAY_SIZE(in), in);
 }
 
+/**
+ * Tests an object against an interface with the interface bitset or against
+ * a class with the preorder uids if the object's class was numbered by this
+ * compilation unit, otherwise asks the runtime.
+ */
+static void lower_guarded_instanceof(ir_node *instanceof)
+{
+	ir_node   *objptr     = get_InstanceOf_ptr(instanceof);
+	ir_type   *type       = get_InstanceOf_type(instanceof);
+	ir_node   *mem        = get_InstanceOf_mem(instanceof);
+	ir_graph  *irg        = get_irn_irg(instanceof);
+
+	ir_node   *join_block = get_nodes_block(instanceof);
+	part_block(instanceof);
+	ir_node   *block      = get_nodes_block(instanceof);
+
+	ir_node   *obj_ci_ref     = load_object_class_info(objptr, type, irg, block, &mem);
+	bool       is_interface   = get_class_depth(type) == OO_CLASS_DEPTH_INTERFACE;
+	ir_entity *numbering_ent  = is_interface ? class_info_interface_numbering
+	                                         : class_info_preorder_numbering;
+	ir_type   *numbering_type = get_entity_type(numbering_ent);
+	ir_node   *numbering_addr = new_r_Member(block, obj_ci_ref, numbering_ent);
+	ir_node   *numbering_load = new_r_Load(block, mem, numbering_addr, mode_P, numbering_type, cons_none);
+	ir_node   *numbering      = new_r_Proj(numbering_load, mode_P, pn_Load_res);
+	           mem            = new_r_Proj(numbering_load, mode_M, pn_Load_M);
+	ir_node   *own_numbering  = new_r_Address(irg, get_unit_numbering());
+	ir_node   *cmp            = new_r_Cmp(block, numbering, own_numbering, ir_relation_equal);
+	ir_node   *cond           = new_r_Cond(block, cmp);
+	ir_node   *proj_own       = new_r_Proj(cond, mode_X, pn_Cond_true);
+	ir_node   *proj_other     = new_r_Proj(cond, mode_X, pn_Cond_false);
+
+	ir_node   *own_block      = new_r_Block(irg, 1, &proj_own);
+	ir_node   *own_mem        = mem;
+	ir_node   *own_res        = is_interface
+		? construct_interface_bit_test(obj_ci_ref, type, irg, own_block, &own_mem)
+		: construct_preorder_range_test(obj_ci_ref, type, irg, own_block, &own_mem);
+
+	ir_node   *other_block    = new_r_Block(irg, 1, &proj_other);
+	ir_node   *other_mem      = mem;
+	ir_node   *other_res      = call_runtime_instanceof(obj_ci_ref, type, irg, other_block, &other_mem);
+
+	ir_node   *join_preds[2]  = { new_r_Jmp(own_block), new_r_Jmp(other_block) };
+	ir_node   *mem_ins[2]     = { own_mem, other_mem };
+	ir_node   *res_ins[2]     = { own_res, other_res };
+	set_irn_in(join_block, 2, join_preds);
+
+	ir_node   *phi_mem        = new_r_Phi(join_block, 2, mem_ins, mode_M);
+	add_Block_phi(join_block, phi_mem);
+	ir_node   *phi_res        = new_r_Phi(join_block, 2, res_ins, mode_b);
+	add_Block_phi(join_block, phi_res);
+
+	set_nodes_block(instanceof, join_block);
+	ir_node *in[pn_InstanceOf_max+1] = {
+		[pn_InstanceOf_M]   = phi_mem,
+		[pn_InstanceOf_res] = phi_res,
+	};
+	turn_into_tuple(instanceof, ARRAY_SIZE(in), in);
+}
+
+void rtti_lower_deferred_instanceofs(ir_graph *irg)
+{
+	if (pdeq_empty(deferred_instanceofs))
+		return;
+
+	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK | IR_RESOURCE_PHI_LIST);
+	collect_phiprojs_and_start_block_nodes(irg);
+
+	while (!pdeq_empty(deferred_instanceofs)) {
+		ir_node *instanceof = pdeq_getl(deferred_instanceofs);
+		assert(get_irn_irg(instanceof) == irg);
+		lower_guarded_instanceof(instanceof);
+	}
+
+	ir_free_resources(irg, IR_RESOURCE_IRN_LINK | IR_RESOURCE_PHI_LIST);
+	confirm_irg_properties(irg, IR_GRAPH_PROPERTIES_NONE);
+}
+
 void rtti_set_runtime_typeinfo_constructor(construct_runtime_typeinfo_t func)
 {
 	assert(func != NULL);
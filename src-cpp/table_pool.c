@@ -0,0 +1,66 @@
+#include "table_pool.h"
+
+#include <string.h>
+#include "adt/hashptr.h"
+
+typedef struct {
+	unsigned      hash;
+	size_t        n;
+	ident *const *contents;
+	ir_entity    *table;
+} table_pool_entry_t;
+
+static unsigned hash_contents(ident *const *contents, size_t n)
+{
+	unsigned hash = (unsigned)n;
+	for (size_t i = 0; i < n; i++)
+		hash = hash * 31 + hash_ptr(contents[i]);
+	return hash;
+}
+
+static unsigned table_pool_entry_hash(const void *obj)
+{
+	return ((const table_pool_entry_t*)obj)->hash;
+}
+
+static int table_pool_entry_cmp(const void *p1, const void *p2)
+{
+	const table_pool_entry_t *e1 = (const table_pool_entry_t*)p1;
+	const table_pool_entry_t *e2 = (const table_pool_entry_t*)p2;
+	return e1->hash == e2->hash && e1->n == e2->n
+	    && memcmp(e1->contents, e2->contents, e1->n * sizeof(*e1->contents)) == 0;
+}
+
+void table_pool_init(table_pool_t *pool)
+{
+	obstack_init(&pool->obst);
+	cpset_init(&pool->tables, table_pool_entry_hash, table_pool_entry_cmp);
+}
+
+void table_pool_destroy(table_pool_t *pool)
+{
+	cpset_destroy(&pool->tables);
+	obstack_free(&pool->obst, NULL);
+}
+
+ir_entity *table_pool_find(table_pool_t *pool, ident *const *contents, size_t n)
+{
+	table_pool_entry_t key;
+	key.hash     = hash_contents(contents, n);
+	key.n        = n;
+	key.contents = contents;
+	key.table    = NULL;
+
+	table_pool_entry_t *found = (table_pool_entry_t*)cpset_find(&pool->tables, &key);
+	return found != NULL ? found->table : NULL;
+}
+
+void table_pool_insert(table_pool_t *pool, ident *const *contents, size_t n, ir_entity *table)
+{
+	table_pool_entry_t *entry = OALLOC(&pool->obst, table_pool_entry_t);
+	entry->hash     = hash_contents(contents, n);
+	entry->n        = n;
+	entry->contents = (ident *const *)obstack_copy(&pool->obst, contents, n * sizeof(*contents));
+	entry->table    = table;
+	cpset_insert(&pool->tables, entry);
+}
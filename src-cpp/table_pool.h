@@ -0,0 +1,27 @@
+#ifndef OO_TABLE_POOL_H
+#define OO_TABLE_POOL_H
+
+#include <stddef.h>
+#include <libfirm/firm.h>
+
+#include "adt/obst.h"
+#include "adt/cpset.h"
+
+/*
+ * Constant tables (itables, RTTI method tables) keyed by their contents:
+ * the linker names of the entities they reference, in order. Tables with
+ * the same key are emitted once and shared.
+ */
+typedef struct {
+	struct obstack obst;
+	cpset_t        tables;
+} table_pool_t;
+
+void table_pool_init(table_pool_t *pool);
+void table_pool_destroy(table_pool_t *pool);
+
+/* Returns the table registered for the given contents or NULL. */
+ir_entity *table_pool_find(table_pool_t *pool, ident *const *contents, size_t n);
+void table_pool_insert(table_pool_t *pool, ident *const *contents, size_t n, ir_entity *table);
+
+#endif
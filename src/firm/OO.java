@@ -16,7 +16,9 @@ public final class OO {
 		RUNTIME_LOOKUP,
 		SEARCHED_ITABLE,
 		INDEXED_ITABLE,
-		SEARCHED_ITABLE_M2F
+		SEARCHED_ITABLE_M2F,
+		IMT,
+		ROW_DISPLACEMENT
 	}
 
 	private OO() {
@@ -53,14 +55,96 @@ public final class OO {
 	 * @param callType
 	 */
 	public static void setInterfaceLookup(InterfaceCallType callType) {
+		setInterfaceLookup(callType, false);
+	}
+
+	/**
+	 * Sets the call-type for interface methods
+	 * @param callType
+	 * @param inlineCache  cache the first (vtable, target) pair at every call site
+	 */
+	public static void setInterfaceLookup(InterfaceCallType callType, boolean inlineCache) {
+		int type = 0;
 		if (callType == InterfaceCallType.RUNTIME_LOOKUP)
-			binding_oo.oo_set_interface_call_type(0);
+			type = 0;
 		else if (callType == InterfaceCallType.SEARCHED_ITABLE)
-			binding_oo.oo_set_interface_call_type(1);
+			type = 1;
 		else if (callType == InterfaceCallType.INDEXED_ITABLE)
-			binding_oo.oo_set_interface_call_type(2);
+			type = 2;
 		else if (callType == InterfaceCallType.SEARCHED_ITABLE_M2F)
-			binding_oo.oo_set_interface_call_type(1 | 4);
+			type = 1 | 4;
+		else if (callType == InterfaceCallType.IMT)
+			type = 16;
+		else if (callType == InterfaceCallType.ROW_DISPLACEMENT)
+			type = 32;
+		if (inlineCache)
+			type |= 8;
+		binding_oo.oo_set_interface_call_type(type);
+	}
+
+	/**
+	 * Sets the number of receiver classes cached per interface call site
+	 * when inline caching is enabled.
+	 */
+	public static void setInlineCacheSize(int size) {
+		binding_oo.oo_set_inline_cache_size(size);
+	}
+
+	/**
+	 * Lets inline cached call sites count the hits of their inline checked
+	 * entry for the runtime statistics.
+	 */
+	public static void setInlineCacheStats(boolean enable) {
+		binding_oo.oo_set_inline_cache_stats(enable);
+	}
+
+	/**
+	 * Lets interfaces that are never implemented together share an ITT
+	 * index when using indexed itables.
+	 */
+	public static void setInterfaceColoring(boolean enable) {
+		binding_oo.oo_set_interface_coloring(enable);
+	}
+
+	/**
+	 * Stores vtable method slots as offsets relative to the vtable, so
+	 * they need no dynamic relocations. Only the method slots are affected,
+	 * see oo_set_relative_vtables.
+	 */
+	public static void setRelativeVtables(boolean enable) {
+		binding_oo.oo_set_relative_vtables(enable);
+	}
+
+	/**
+	 * Places up to nSlots itable pointers of a class in front of its vtable
+	 * when using indexed itables, saving one load per interface call. Has
+	 * to be called before init.
+	 */
+	public static void setEmbeddedItts(int nSlots) {
+		binding_oo.oo_set_embedded_itts(nSlots);
+	}
+
+	/**
+	 * Promises that no classes besides the known ones exist at runtime,
+	 * which lets lowerProgram infer final classes and methods.
+	 */
+	public static void setClosedWorld(boolean enable) {
+		binding_oo.oo_set_closed_world(enable);
+	}
+
+	/**
+	 * Lets lowerProgram number the class tree in preorder, so subclass tests
+	 * become a range check. Needs the complete class hierarchy.
+	 */
+	public static void setPreorderClassUIDs(boolean enable) {
+		binding_oo.oo_set_preorder_class_uids(enable);
+	}
+
+	/**
+	 * Assigns the preorder class uids right away instead of in lowerProgram.
+	 */
+	public static void assignPreorderClassUIDs() {
+		binding_oo.oo_assign_preorder_class_uids();
 	}
 
 	/**
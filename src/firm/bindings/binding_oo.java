@@ -2944,7 +2944,10 @@ public class binding_oo {
 		call_runtime_lookup(0),
 		call_searched_itable(1),
 		call_itable_indexed(2),
-		call_move2front(4);
+		call_move2front(4),
+		call_inline_cache(8),
+		call_imt(16),
+		call_row_displacement(32);
 		public final int val;
 
 		private static class C {
@@ -2980,10 +2983,52 @@ public class binding_oo {
 
 	public static native /* ddispatch_interface_call */int oo_get_interface_call_type();
 
+	public static native void oo_set_inline_cache_size(int size);
+
+	public static native int oo_get_inline_cache_size();
+
+	public static native void oo_set_inline_cache_stats(boolean enable);
+
+	public static native boolean oo_get_inline_cache_stats();
+
+	public static native void oo_set_interface_coloring(boolean enable);
+
+	public static native boolean oo_get_interface_coloring();
+
+	public static native void oo_set_relative_vtables(boolean enable);
+
+	public static native boolean oo_get_relative_vtables();
+
+	public static native void oo_set_embedded_itts(int n_slots);
+
+	public static native int oo_get_embedded_itts();
+
+	public static native void oo_set_closed_world(boolean enable);
+
+	public static native boolean oo_get_closed_world();
+
+	public static native void oo_set_preorder_class_uids(boolean enable);
+
+	public static native boolean oo_get_preorder_class_uids();
+
+	public static native void oo_assign_preorder_class_uids();
+
 	public static native int oo_get_class_uid(Pointer classtype);
 
 	public static native void oo_set_class_uid(Pointer classtype, int uid);
 
+	public static native int oo_get_class_preorder_uid(Pointer classtype);
+
+	public static native void oo_set_class_preorder_uid(Pointer classtype, int uid);
+
+	public static native int oo_get_class_max_subclass_uid(Pointer classtype);
+
+	public static native void oo_set_class_max_subclass_uid(Pointer classtype, int uid);
+
+	public static native int oo_get_class_preorder_numbering(Pointer classtype);
+
+	public static native void oo_set_class_preorder_numbering(Pointer classtype, int numbering);
+
 	public static native Pointer oo_get_class_vtable_entity(Pointer classtype);
 
 	public static native void oo_set_class_vtable_entity(Pointer classtype, Pointer vtable);
@@ -3064,5 +3109,7 @@ public class binding_oo {
 
 	public static native Pointer oo_get_entity_overwritten_superclass_entity(Pointer entity);
 
+	public static native Pointer oo_get_method_implementation(Pointer method);
+
 	public static native void oo_copy_entity_info(Pointer src, Pointer dest);
 }